@@ -21,9 +21,34 @@ CONF_ON_DATA_CHANGE = "on_data_change"
 CONF_ON_ERROR = "on_error"
 CONF_RETRY_COUNT = "retry_count"
 CONF_RETRY_DELAY = "retry_delay"
+CONF_HISTORY_SIZE = "history_size"
+CONF_PROBE_PUBLISH_TIME = "probe_publish_time"
+CONF_PREFETCH = "prefetch"
+CONF_ENDPOINT = "endpoint"
+CONF_TRACE = "trace"
+CONF_REQUEST_BUDGET = "request_budget"
+CONF_MAX_REQUESTS = "max_requests"
+CONF_WINDOW = "window"
+CONF_RESERVE = "reserve"
 CONF_MOENV_AQI_ID = "moenv_aqi_id"
 CONF_HTTP_REQUEST_ID = "http_request_id"
 
+
+def validate_request_budget(config):
+    if config[CONF_RESERVE] >= config[CONF_MAX_REQUESTS]:
+        raise cv.Invalid(f"{CONF_RESERVE} must be less than {CONF_MAX_REQUESTS}")
+    return config
+
+
+def validate_single_request_budget(configs):
+    # The budget covers every request the device makes, so it is configured once
+    if sum(CONF_REQUEST_BUDGET in config for config in configs) > 1:
+        raise cv.Invalid(
+            f"{CONF_REQUEST_BUDGET} applies to all instances and may only be set once"
+        )
+    return configs
+
+
 CHILD_SCHEMA = cv.Schema(
     {
         cv.GenerateID(CONF_MOENV_AQI_ID): cv.use_id(MoenvAQI),
@@ -41,6 +66,9 @@ CONFIG_SCHEMA = cv.All(
                 ),
                 cv.Optional(CONF_API_KEY, default=""): cv.templatable(cv.string),
                 cv.Optional(CONF_SITE_NAME, default=""): cv.templatable(cv.string),
+                cv.Optional(
+                    CONF_ENDPOINT, default="https://data.moenv.gov.tw/api/v2/aqx_p_432"
+                ): cv.templatable(cv.url),
                 cv.Optional(CONF_LANGUAGE, default="zh"): cv.templatable(cv.string),
                 cv.Optional(CONF_LIMIT, default=20): cv.templatable(cv.uint32_t),
                 cv.Optional(CONF_SENSOR_EXPIRY, default="90min"): cv.templatable(
@@ -60,15 +88,50 @@ CONFIG_SCHEMA = cv.All(
                         cv.positive_time_period_milliseconds,
                     )
                 ),
+                cv.Optional(CONF_PROBE_PUBLISH_TIME, default=True): cv.templatable(
+                    cv.boolean
+                ),
+                cv.Optional(CONF_PREFETCH, default=False): cv.templatable(cv.boolean),
+                cv.Optional(CONF_HISTORY_SIZE, default=24): cv.int_range(
+                    min=2, max=168
+                ),
+                cv.Optional(CONF_TRACE, default=False): cv.boolean,
+                cv.Optional(CONF_REQUEST_BUDGET): cv.All(
+                    cv.Schema(
+                        {
+                            cv.Required(CONF_MAX_REQUESTS): cv.int_range(
+                                min=1, max=65535
+                            ),
+                            cv.Optional(CONF_WINDOW, default="1h"): cv.All(
+                                cv.positive_time_period_seconds,
+                                cv.Range(min=cv.TimePeriod(minutes=1)),
+                            ),
+                            cv.Optional(CONF_RESERVE, default=2): cv.int_range(
+                                min=0
+                            ),
+                        }
+                    ),
+                    validate_request_budget,
+                ),
             }
         ).extend(cv.polling_component_schema("never"))
     ),
+    validate_single_request_budget,
     cv.only_on_esp32,
     cv.require_esphome_version(2026, 2, 0),
 )
 
 
 async def to_code(configs):
+    # The history ring is sized at compile time for the largest history_size; each
+    # instance still limits its own statistics window to its configured size
+    cg.add_define(
+        "MOENV_AQI_HISTORY_SIZE", max(config[CONF_HISTORY_SIZE] for config in configs)
+    )
+    # Trace spans are compiled out entirely unless requested
+    if any(config[CONF_TRACE] for config in configs):
+        cg.add_define("MOENV_AQI_TRACE")
+
     for config in configs:
         var = cg.new_Pvariable(config[CONF_ID])
         await cg.register_component(var, config)
@@ -85,6 +148,9 @@ async def to_code(configs):
         if CONF_SITE_NAME in config:
             site_name = await cg.templatable(config[CONF_SITE_NAME], [], cg.std_string)
             cg.add(var.set_site_name(site_name))
+        if CONF_ENDPOINT in config:
+            endpoint = await cg.templatable(config[CONF_ENDPOINT], [], cg.std_string)
+            cg.add(var.set_endpoint(endpoint))
         if CONF_LANGUAGE in config:
             language = await cg.templatable(config[CONF_LANGUAGE], [], cg.std_string)
             cg.add(var.set_language(language))
@@ -110,3 +176,18 @@ async def to_code(configs):
         if CONF_RETRY_DELAY in config:
             retry_delay = await cg.templatable(config[CONF_RETRY_DELAY], [], cg.uint32)
             cg.add(var.set_retry_delay(retry_delay))
+        if CONF_PROBE_PUBLISH_TIME in config:
+            probe = await cg.templatable(config[CONF_PROBE_PUBLISH_TIME], [], cg.bool_)
+            cg.add(var.set_probe_publish_time(probe))
+        if CONF_PREFETCH in config:
+            prefetch = await cg.templatable(config[CONF_PREFETCH], [], cg.bool_)
+            cg.add(var.set_prefetch(prefetch))
+        cg.add(var.set_history_size(config[CONF_HISTORY_SIZE]))
+        if budget := config.get(CONF_REQUEST_BUDGET):
+            cg.add(
+                var.set_request_budget(
+                    budget[CONF_MAX_REQUESTS],
+                    budget[CONF_WINDOW].total_seconds,
+                    budget[CONF_RESERVE],
+                )
+            )
@@ -0,0 +1,657 @@
+#include "fetch_coordinator.h"
+
+#include <ArduinoJson.h>
+#include <esp_heap_caps.h>
+#include <esp_system.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "esphome/core/application.h"
+#include "esphome/core/log.h"
+
+#include "moenv_aqi.h"
+#include "trace.h"
+
+namespace esphome {
+namespace moenv_aqi {
+
+static constexpr size_t MAX_RECORDS_CHECKED = 500;
+static constexpr size_t URL_BASE_RESERVE_SIZE = 256;
+static constexpr size_t URL_OFFSET_RESERVE_SIZE = 20;
+// A prefetch keeps a second TLS connection open; leave room for its buffers and handshake
+static constexpr uint32_t PREFETCH_MIN_FREE_HEAP = 50 * 1024;
+static constexpr uint32_t PREFETCH_MIN_FREE_BLOCK = 20 * 1024;
+
+FetchCoordinator global_fetch_coordinator;  // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+// Response headers kept for conditional requests; http_request matches them in lower case
+static const char *const ETAG_HEADER = "etag";
+static const char *const LAST_MODIFIED_HEADER = "last-modified";
+
+static uint32_t fnv1a_hash(const char *str) {
+  uint32_t hash = HttpStreamAdapter::FNV1A_OFFSET_BASIS;
+  while (*str) hash = (hash ^ static_cast<uint8_t>(*str++)) * HttpStreamAdapter::FNV1A_PRIME;
+  return hash;
+}
+
+static bool find_next_record(HttpStreamAdapter &stream) {
+  MOENV_TRACE_SCOPE("find");
+  return stream.findUntil(",", "]");
+}
+
+void FetchCoordinator::enqueue(MoenvAQI *instance) {
+  if (std::find(pending_.begin(), pending_.end(), instance) == pending_.end()) {
+    pending_.push_back(instance);
+  }
+}
+
+void FetchCoordinator::run() {
+  while (!pending_.empty()) {
+    this->take_batch_();
+
+    // Normal updates wait while the request budget is down to its reserve
+    if (!targets_.empty()) {
+      bool priority = false;
+      for (const auto &target : targets_) priority = priority || target.owner->needs_priority_();
+      budget_.advance(targets_.front().owner->rtc_->now().timestamp);
+      allowance_ = budget_.allowance(priority);
+      pass_requests_ = 0;
+      budget_stopped_ = false;
+      if (allowance_ == 0) {
+        ESP_LOGW(TAG, "Request budget down to its reserve (%u of %u used), skipping %u lookup(s)", budget_.used(),
+                 budget_.get_max_requests(), targets_.size());
+        for (auto &target : targets_) target.owner->skip_fetch_();
+        targets_.clear();
+        continue;
+      }
+    }
+
+    if (!targets_.empty()) {
+#ifdef MOENV_AQI_TRACE
+      global_tracer.clear();
+#endif
+      const uint32_t pass_start = millis();
+      pass_stall_ms_ = 0;
+      {
+        MOENV_TRACE_SCOPE("scan");
+        this->scan_();
+        this->cancel_prefetch_();
+      }
+      const uint32_t pass_ms = millis() - pass_start;
+      worst_pass_ms_ = std::max(worst_pass_ms_, pass_ms);
+      worst_stall_ms_ = std::max(worst_stall_ms_, pass_stall_ms_);
+      ESP_LOGD(TAG, "Fetch pass blocked for %u ms (worst %u ms), longest read stall %u ms (worst %u ms), "
+               "lowest free heap %u bytes",
+               pass_ms, worst_pass_ms_, pass_stall_ms_, worst_stall_ms_, lowest_free_heap_);
+      ESP_LOGD(TAG, "JSON arena peak %u of %u bytes, %u heap fallback(s)", arena_.get_peak(), JsonArena::SIZE,
+               arena_.get_overflows());
+      if (prefetch_used_ + prefetch_cancelled_ + prefetch_skipped_ > 0) {
+        ESP_LOGD(TAG, "Prefetches used: %u, cancelled: %u, skipped for low heap: %u", prefetch_used_,
+                 prefetch_cancelled_, prefetch_skipped_);
+      }
+      if (budget_.enabled()) {
+        ESP_LOGD(TAG, "Request budget: %u request(s) this pass, %u of %u left", pass_requests_, budget_.remaining(),
+                 budget_.get_max_requests());
+        budget_.save();
+      }
+    }
+
+    // Each instance applies its own success, retry or on_error handling. A lookup the
+    // budget cut short has not failed; it waits for the next update and resumes there.
+    for (auto &target : targets_) {
+      MOENV_TRACE_SCOPE("finish");
+      if (budget_stopped_ && !target.resolved) {
+        target.owner->checkpoint_.deferred = true;
+        target.owner->skip_fetch_();
+        continue;
+      }
+      target.owner->finish_fetch_(target.resolved && target.success);
+    }
+    targets_.clear();
+#ifdef MOENV_AQI_TRACE
+    global_tracer.log_summary();
+    global_tracer.log_chrome_trace();
+#endif
+  }
+}
+
+bool FetchCoordinator::same_query_(MoenvAQI *a, MoenvAQI *b) {
+  return a->http_request_ == b->http_request_ && a->limit_.value() == b->limit_.value() &&
+         a->endpoint_.value() == b->endpoint_.value() && a->api_key_.value() == b->api_key_.value() &&
+         a->language_.value() == b->language_.value();
+}
+
+// Move every pending instance that can share the leader's query into targets_, then
+// bring forward registered instances sharing it whose own update is due soon.
+// In place and order preserving, since std::stable_partition takes a temporary buffer
+void FetchCoordinator::take_batch_() {
+  MoenvAQI *leader = pending_.front();
+  size_t kept = 0;
+
+  targets_.clear();
+  for (size_t i = 0; i < pending_.size(); i++) {
+    MoenvAQI *instance = pending_[i];
+    if (!same_query_(leader, instance)) {
+      pending_[kept++] = instance;
+      continue;
+    }
+    this->add_target_(instance);
+  }
+  pending_.resize(kept);
+
+  for (MoenvAQI *instance : instances_) {
+    if (this->is_target_(instance) || std::find(pending_.begin(), pending_.end(), instance) != pending_.end()) {
+      continue;
+    }
+    if (same_query_(leader, instance) && instance->join_early_()) this->add_target_(instance);
+  }
+
+  std::sort(targets_.begin(), targets_.end(),
+            [](const Target &a, const Target &b) { return a.site_hash < b.site_hash; });
+  remaining_ = targets_.size();
+}
+
+void FetchCoordinator::add_target_(MoenvAQI *instance) {
+  if (!instance->prepare_fetch_()) {
+    instance->finish_fetch_(false);
+    return;
+  }
+  Target target{};
+  target.site_name = instance->site_name_.value();
+  target.site_hash = fnv1a_hash(target.site_name.c_str());
+  target.owner = instance;
+  targets_.push_back(std::move(target));
+}
+
+bool FetchCoordinator::is_target_(MoenvAQI *instance) const {
+  for (const auto &target : targets_) {
+    if (target.owner == instance) return true;
+  }
+  return false;
+}
+
+// One streaming pass over the dataset on behalf of every target in the batch
+void FetchCoordinator::scan_() {
+  MoenvAQI *leader = targets_.front().owner;
+  const size_t limit = leader->limit_.value();
+  const size_t max_pages = std::max<size_t>(MAX_RECORDS_CHECKED / limit, 1);
+
+  // Resume from a retry checkpoint if there is one; otherwise start from the earliest
+  // offset any target was last seen at and let the wrap-around cover the rest
+  const ScanCheckpoint *resume = nullptr;
+  size_t start_offset = leader->last_successful_offset_;
+  end_page_ = -1;
+  for (const auto &target : targets_) {
+    const ScanCheckpoint &checkpoint = target.owner->checkpoint_;
+    if (checkpoint.active && resume == nullptr) resume = &checkpoint;
+    if (checkpoint.end_page >= 0) end_page_ = checkpoint.end_page;
+    start_offset = std::min(start_offset, target.owner->last_successful_offset_);
+  }
+  // Every target shares the query, so the end of the data one of them has seen applies to
+  // all; without it a target could never be found exhausted and skipping would not wrap
+  if (end_page_ >= 0) {
+    for (auto &target : targets_) {
+      if (target.owner->checkpoint_.end_page < 0) target.owner->checkpoint_.end_page = end_page_;
+    }
+  }
+  size_t page = resume != nullptr ? resume->page : start_offset / limit;
+  bool wrapped = resume != nullptr && resume->wrapped;
+  if (resume != nullptr) {
+    ESP_LOGD(TAG, "Resuming scan from checkpoint at offset %u", page * limit);
+  }
+
+  // Build the URL in place; clear() keeps the capacity from earlier passes
+  url_.reserve(URL_BASE_RESERVE_SIZE + URL_OFFSET_RESERVE_SIZE);
+  url_.clear();
+  url_ += leader->endpoint_.value();
+  url_ += url_.find('?') == std::string::npos ? "?language=" : "&language=";
+  url_ += leader->language_.value();
+  url_ += "&api_key=";
+  url_ += leader->api_key_.value();
+  if (limit > 0) {
+    char number[12];
+    snprintf(number, sizeof(number), "%u", static_cast<unsigned>(limit));
+    url_ += "&limit=";
+    url_ += number;
+  }
+  url_base_length_ = url_.size();
+  url_base_hash_ = fnv1a_hash(url_.c_str());
+  int32_t unconditional_page = -1;  // set after a 304 that left targets needing the body
+
+  // Prefetching may request a page that goes unused; not worth it on a tight budget
+  bool prefetch = false;
+  for (const auto &target : targets_) prefetch = prefetch || target.owner->prefetch_.value();
+  prefetch = prefetch && !budget_.low();
+
+  fetch_start_ = millis();
+  fetch_bytes_ = 0;
+  size_t pages_checked = 0;
+  size_t pages_skipped = 0;
+  int records_count = 0;
+
+  while (true) {
+    this->resolve_exhausted_();
+    if (remaining_ == 0) return;
+
+    // Skipped pages are bounded too, in case no target can tell where the data ends
+    if (pages_checked >= max_pages || pages_skipped > ScanCheckpoint::MAX_PAGES ||
+        page >= ScanCheckpoint::MAX_PAGES) {
+      ESP_LOGW(TAG, "Safeguard: checked over %u records, aborting search.", MAX_RECORDS_CHECKED);
+      break;
+    }
+
+    // Skip pages that every remaining target already knows to be empty of its site
+    if (this->page_cleared_(page)) {
+      ESP_LOGV(TAG, "Skipping offset %u, already scanned", page * limit);
+      pages_skipped++;
+      if (end_page_ >= 0 && page >= static_cast<size_t>(end_page_)) {
+        page = 0;
+        wrapped = true;
+      } else {
+        page++;
+      }
+      continue;
+    }
+
+    const bool prefetched = prefetch_container_ != nullptr && prefetch_page_ == page;
+    if (!prefetched && pass_requests_ >= allowance_) {
+      ESP_LOGW(TAG, "Request budget allows no more requests this pass, stopping at offset %u", page * limit);
+      budget_stopped_ = true;
+      break;
+    }
+
+    offset_ = page * limit;
+    App.feed_wdt();
+
+    std::shared_ptr<http_request::HttpContainer> container;
+    if (prefetched) {
+      ESP_LOGD(TAG, "Using prefetched response for offset %u", offset_);
+      container = std::move(prefetch_container_);
+      prefetch_used_++;
+    } else {
+      this->cancel_prefetch_();
+      this->set_page_url_(offset_);
+      ESP_LOGD(TAG, "Sending query: %s", url_.c_str());
+      ESP_LOGD(TAG, "Before request: free heap:%u, max block:%u",
+               esp_get_free_heap_size(),
+               heap_caps_get_largest_free_block(MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL));
+      {
+        MOENV_TRACE_SCOPE("connect");
+        container = this->request_(leader, offset_, static_cast<int32_t>(page) != unconditional_page);
+      }
+
+      ESP_LOGD(TAG, "After request: free heap:%u, max block:%u",
+               esp_get_free_heap_size(),
+               heap_caps_get_largest_free_block(MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL));
+      this->sample_heap_();
+    }
+
+    if (container == nullptr) {
+      ESP_LOGE(TAG, "HTTP request failed: no response container");
+      break;
+    }
+
+    // The page is byte-for-byte what was read last time, so is the snapshot it belongs to.
+    // The round trip is not a page fetch; only the re-request that follows one counts.
+    if (container->status_code == 304 && static_cast<int32_t>(page) != unconditional_page) {
+      container->end();
+      const PageValidator *validator = this->find_validator_(this->page_key_(offset_));
+      if (validator != nullptr) {
+        ESP_LOGD(TAG, "Offset %u not modified, snapshot %s", offset_, validator->publish_time);
+        this->resolve_not_modified_(validator->publish_time,
+                                    ScanProgress{offset_, fetch_bytes_, millis() - fetch_start_});
+      }
+      if (remaining_ == 0) return;
+      unconditional_page = page;
+      continue;
+    }
+
+    if (container->status_code != 200) {
+      ESP_LOGE(TAG, "HTTP request failed with code: %d", container->status_code);
+      container->end();
+      break;
+    }
+
+    pages_checked++;
+    for (auto &target : targets_) {
+      if (target.resolved) continue;
+      ScanCheckpoint &checkpoint = target.owner->checkpoint_;
+      checkpoint.pages_fetched++;
+      if (checkpoint.fetched.test(page)) checkpoint.pages_refetched++;
+      checkpoint.fetched.set(page);
+    }
+
+    // Past the first page the scan is searching; overlap the next page's connection and
+    // response headers with reading this one, whose body keeps arriving meanwhile
+    if (prefetch && pages_checked > 1 && pages_checked < max_pages && pass_requests_ < allowance_) {
+      const size_t next = end_page_ >= 0 && page >= static_cast<size_t>(end_page_) ? 0 : page + 1;
+      if (next < ScanCheckpoint::MAX_PAGES && !this->page_cleared_(next)) {
+        this->start_prefetch_(leader, next, limit);
+      }
+    }
+
+    App.feed_wdt();
+    ESP_LOGD(TAG, "Looking for %u site(s) at offset %u", remaining_, offset_);
+
+    HttpStreamAdapter stream(container, stream_buffer_, sizeof(stream_buffer_), leader->http_request_->get_timeout());
+    const bool complete = this->process_page_(stream, records_count);
+    ESP_LOGD(TAG, "Processed %zu bytes, records_count: %d", stream.getBytesRead(), records_count);
+    fetch_bytes_ += stream.getBytesRead();
+    if (complete) this->save_validator_(this->page_key_(offset_), container.get());
+
+    container->end();
+
+    ESP_LOGD(TAG, "After json parse: free heap:%u, max block:%u",
+             esp_get_free_heap_size(),
+             heap_caps_get_largest_free_block(MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL));
+    this->sample_heap_();
+
+    const uint32_t timeout = leader->http_request_->get_timeout();
+    pass_stall_ms_ = std::max(pass_stall_ms_, stream.getMaxStallMs());
+    if (stream.getMaxStallMs() >= timeout / 2) {
+      ESP_LOGW(TAG, "Read stalled for %u ms at offset %u (timeout %u ms)", stream.getMaxStallMs(), offset_, timeout);
+    }
+
+    if (remaining_ == 0) return;
+
+    // A truncated page says nothing about where the data ends; retry it rather than wrapping
+    if (!complete) {
+      ESP_LOGE(TAG, "Response at offset %u was cut short", offset_);
+      break;
+    }
+
+    ESP_LOGD(TAG, "%u site(s) not found at offset %u (records_count: %d, limit: %u)",
+             remaining_, offset_, records_count, limit);
+
+    // The page was read completely; none of the remaining sites are on it
+    const bool last_page = records_count == 0 || records_count < (int) limit;
+    if (last_page) end_page_ = page;
+    for (auto &target : targets_) {
+      if (target.resolved) continue;
+      ScanCheckpoint &checkpoint = target.owner->checkpoint_;
+      checkpoint.cleared.set(page);
+      if (last_page) checkpoint.end_page = end_page_;
+    }
+
+    if (last_page) {
+      ESP_LOGD(TAG, "Reached end of data, wrapping around to offset 0");
+      page = 0;
+      wrapped = true;
+    } else {
+      page++;
+    }
+  }
+
+  // Let the retries of unresolved targets continue from here
+  this->save_checkpoints_(page, wrapped);
+}
+
+// Point url_ at the page starting at this offset, reusing the base built by scan_()
+void FetchCoordinator::set_page_url_(size_t offset) {
+  char number[12];
+  snprintf(number, sizeof(number), "%u", static_cast<unsigned>(offset));
+  url_.resize(url_base_length_);
+  url_ += "&offset=";
+  url_ += number;
+}
+
+// Request a page ahead of time, if the heap can hold a second connection
+void FetchCoordinator::start_prefetch_(MoenvAQI *leader, size_t page, size_t limit) {
+  const uint32_t free_heap = esp_get_free_heap_size();
+  const uint32_t max_block = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
+  if (free_heap < PREFETCH_MIN_FREE_HEAP || max_block < PREFETCH_MIN_FREE_BLOCK) {
+    ESP_LOGD(TAG, "Not prefetching offset %u: free heap:%u, max block:%u", page * limit, free_heap, max_block);
+    prefetch_skipped_++;
+    return;
+  }
+
+  this->set_page_url_(page * limit);
+  ESP_LOGD(TAG, "Prefetching query: %s", url_.c_str());
+  {
+    MOENV_TRACE_SCOPE("prefetch");
+    prefetch_container_ = this->request_(leader, page * limit, true);
+  }
+  prefetch_page_ = page;
+  this->sample_heap_();
+}
+
+// Send a request for url_, counting it against the budget whatever the outcome.
+// A conditional request carries the validators from the last full read of the page.
+std::shared_ptr<http_request::HttpContainer> FetchCoordinator::request_(MoenvAQI *leader, size_t offset,
+                                                                        bool conditional) {
+  pass_requests_++;
+  budget_.record();
+
+  if (collect_headers_.empty()) {
+    collect_headers_.insert(ETAG_HEADER);
+    collect_headers_.insert(LAST_MODIFIED_HEADER);
+  }
+  // Header nodes move between the two lists instead of being freed, and keep their
+  // string capacity, so after the first conditional request no header allocates
+  spare_headers_.splice(spare_headers_.end(), headers_);
+  const PageValidator *validator = conditional ? this->find_validator_(this->page_key_(offset)) : nullptr;
+  if (validator != nullptr) {
+    if (validator->etag[0] != '\0') this->add_header_("If-None-Match", validator->etag);
+    if (validator->last_modified[0] != '\0') this->add_header_("If-Modified-Since", validator->last_modified);
+  }
+  return leader->http_request_->get(url_, headers_, collect_headers_);
+}
+
+void FetchCoordinator::add_header_(const char *name, const char *value) {
+  if (spare_headers_.empty()) spare_headers_.emplace_back();
+  headers_.splice(headers_.end(), spare_headers_, spare_headers_.begin());
+  headers_.back().name.assign(name);
+  headers_.back().value.assign(value);
+}
+
+// Identifies a page of the current query (endpoint, key, language, limit) by its offset
+uint32_t FetchCoordinator::page_key_(size_t offset) const {
+  return (url_base_hash_ ^ static_cast<uint32_t>(offset)) * HttpStreamAdapter::FNV1A_PRIME;
+}
+
+PageValidator *FetchCoordinator::find_validator_(uint32_t key) {
+  for (auto &validator : validators_) {
+    if (validator.key == key && validator.publish_time[0] != '\0') return &validator;
+  }
+  return nullptr;
+}
+
+// Copy a collected response header into a fixed buffer, through a string reused across
+// pages. Returns false if the value does not fit; a missing header is stored as empty.
+bool FetchCoordinator::read_header_(http_request::HttpContainer *container, const char *name, char *buffer,
+                                    size_t size) {
+  header_value_ = container->get_response_header(name);
+  if (header_value_.size() >= size) return false;
+  memcpy(buffer, header_value_.c_str(), header_value_.size() + 1);
+  return true;
+}
+
+// Remember the validators of a page that was read, if the server sent any that fit
+void FetchCoordinator::save_validator_(uint32_t key, http_request::HttpContainer *container) {
+  PageValidator validator{};
+  const bool usable = page_publish_time_[0] != '\0' &&
+                      this->read_header_(container, ETAG_HEADER, validator.etag, PageValidator::ETAG_SIZE) &&
+                      this->read_header_(container, LAST_MODIFIED_HEADER, validator.last_modified,
+                                         PageValidator::DATE_SIZE) &&
+                      (validator.etag[0] != '\0' || validator.last_modified[0] != '\0');
+
+  PageValidator *slot = this->find_validator_(key);
+  if (!usable) {
+    if (slot != nullptr) *slot = PageValidator{};
+    return;
+  }
+  if (slot == nullptr) {
+    slot = &validators_[next_validator_];
+    next_validator_ = (next_validator_ + 1) % MAX_VALIDATORS;
+  }
+  validator.key = key;
+  memcpy(validator.publish_time, page_publish_time_, PageValidator::DATE_SIZE);
+  *slot = validator;
+}
+
+// Close a prefetched response that the scan no longer needs
+void FetchCoordinator::cancel_prefetch_() {
+  if (prefetch_container_ == nullptr) return;
+  ESP_LOGD(TAG, "Cancelling prefetched page %u", prefetch_page_);
+  prefetch_container_->end();
+  prefetch_container_.reset();
+  prefetch_cancelled_++;
+}
+
+// Resolve, as failed, every target whose checkpoint shows a full scan without its site
+void FetchCoordinator::resolve_exhausted_() {
+  for (auto &target : targets_) {
+    if (target.resolved || !target.owner->checkpoint_.exhausted()) continue;
+    ESP_LOGW(TAG, "Site '%s' not found after full scan", target.site_name.c_str());
+    target.resolved = true;
+    target.success = false;
+    remaining_--;
+    // A single short page is enough to end the data, so a retry must read it all again
+    // rather than trust this scan's idea of where the data ends
+    target.owner->checkpoint_.restart();
+  }
+}
+
+bool FetchCoordinator::page_cleared_(size_t page) const {
+  for (const auto &target : targets_) {
+    if (!target.resolved && !target.owner->checkpoint_.cleared.test(page)) return false;
+  }
+  return true;
+}
+
+void FetchCoordinator::sample_heap_() {
+  lowest_free_heap_ = std::min<uint32_t>(lowest_free_heap_, esp_get_free_heap_size());
+}
+
+void FetchCoordinator::save_checkpoints_(size_t page, bool wrapped) {
+  for (auto &target : targets_) {
+    if (target.resolved) continue;
+    ScanCheckpoint &checkpoint = target.owner->checkpoint_;
+    checkpoint.page = page;
+    checkpoint.wrapped = wrapped;
+    checkpoint.active = true;
+  }
+}
+
+ScanProgress FetchCoordinator::progress_(const HttpStreamAdapter &stream) const {
+  return ScanProgress{offset_, static_cast<uint32_t>(fetch_bytes_ + stream.getBytesRead()), millis() - fetch_start_};
+}
+
+// Stream one page of records, dispatching each target's record to its owner.
+// Returns false if the body could not be read to the end.
+bool FetchCoordinator::process_page_(HttpStreamAdapter &stream, int &records_count) {
+  records_count = 0;
+  page_publish_time_[0] = '\0';
+
+  MOENV_TRACE_SCOPE("page");
+  if (!stream.find("[")) {
+    ESP_LOGE(TAG, "Could not find array start '['");
+    return !stream.hasError();
+  }
+
+  JsonDocument &doc = doc_;
+  bool first_record = true;
+
+  // Iterate through each record in the array
+  do {
+    App.feed_wdt();
+    int next;
+    while ((next = stream.peek()) == ' ' || next == '\n' || next == '\r' || next == '\t') stream.read();
+    if (next == ']') break;  // Empty page
+
+    stream.resetFingerprint();
+    // The previous record is no longer referenced; release it and rewind the arena
+    doc.clear();
+    arena_.reset();
+    DeserializationError error;
+    {
+      MOENV_TRACE_SCOPE("deserialize");
+      error = deserializeJson(doc, stream);
+    }
+    // Records that fail to parse count too, or their page would be taken for the last one
+    records_count++;
+    if (error) {
+      ESP_LOGE(TAG, "deserializeJson() failed: %s", error.c_str());
+      if (error == DeserializationError::IncompleteInput) return false;  // Body ended mid-record
+      stream.find("}");  // Records are flat; skip the rest of this one
+      continue;
+    }
+    const uint32_t fingerprint = stream.getFingerprint();
+
+    // The first record's publishtime identifies the snapshot; anything but a string cannot
+    // be compared with the stored one
+    if (first_record) {
+      first_record = false;
+      JsonVariant publish_time_json = doc[FIELD_PUBLISH_TIME];
+      if (publish_time_json.is<const char *>()) {
+        // Validators are only kept for a page whose snapshot is known
+        const char *publish_time = publish_time_json.as<const char *>();
+        if (strlen(publish_time) < sizeof(page_publish_time_)) strcpy(page_publish_time_, publish_time);
+        this->resolve_probe_(publish_time, this->progress_(stream));
+        if (remaining_ == 0) return true;
+      } else if (!publish_time_json.isNull()) {
+        ESP_LOGW(TAG, "'publishtime' field is not a string, not probing or caching validators for offset %u",
+                 offset_);
+      }
+    }
+
+    // Extract the sitename
+    JsonVariant sitename_json = doc[FIELD_SITENAME];
+    if (!sitename_json) {
+      ESP_LOGW(TAG, "Could not find 'sitename' field, skipping record");
+      continue;
+    }
+    if (sitename_json.isNull()) {
+      ESP_LOGW(TAG, "'sitename' field is null, skipping record");
+      continue;
+    }
+    if (!sitename_json.is<const char *>()) {
+      ESP_LOGW(TAG, "'sitename' field is not a string, skipping record");
+      continue;
+    }
+
+    const char *sitename = sitename_json.as<const char *>();
+    ESP_LOGV(TAG, "sitename: %s", sitename);
+
+    // Check if this is a target site; several instances may track the same site
+    const uint32_t hash = fnv1a_hash(sitename);
+    auto it = std::lower_bound(targets_.begin(), targets_.end(), hash,
+                               [](const Target &t, uint32_t h) { return t.site_hash < h; });
+    for (; it != targets_.end() && it->site_hash == hash; ++it) {
+      if (it->resolved || it->site_name != sitename) continue;
+      ESP_LOGD(TAG, "Found target site: %s", sitename);
+      it->resolved = true;
+      it->success = it->owner->handle_record_(doc, fingerprint, this->progress_(stream));
+      remaining_--;
+    }
+    if (remaining_ == 0) return true;
+  } while (find_next_record(stream));
+  return !stream.hasError();
+}
+
+// Resolve every target whose stored record already has this snapshot's publish time
+void FetchCoordinator::resolve_probe_(const char *publish_time, const ScanProgress &progress) {
+  for (auto &target : targets_) {
+    if (target.resolved || !target.owner->probe_matches_(publish_time)) continue;
+    target.resolved = true;
+    target.success = true;
+    target.owner->handle_probe_hit_(progress);
+    remaining_--;
+  }
+}
+
+// Resolve every target whose stored record belongs to a snapshot the server confirmed unchanged
+void FetchCoordinator::resolve_not_modified_(const char *publish_time, const ScanProgress &progress) {
+  for (auto &target : targets_) {
+    if (target.resolved || !target.owner->snapshot_matches_(publish_time)) continue;
+    target.resolved = true;
+    target.success = true;
+    target.owner->handle_not_modified_(progress);
+    remaining_--;
+  }
+}
+
+}  // namespace moenv_aqi
+}  // namespace esphome
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <ArduinoJson.h>
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "http_stream_adapter.h"
+#include "json_arena.h"
+#include "request_budget.h"
+
+namespace esphome {
+namespace moenv_aqi {
+
+class MoenvAQI;
+
+namespace testing {
+class Probe;
+}  // namespace testing
+
+/// Where a shared scan currently is, passed to instances when their record is resolved.
+struct ScanProgress {
+  size_t offset;
+  uint32_t bytes;
+  uint32_t elapsed_ms;
+};
+
+/// Scan progress kept by an instance across retries, so a page that fails late in a
+/// long wrap-around scan does not send the next attempt back to the first page.
+struct ScanCheckpoint {
+  static constexpr size_t MAX_PAGES = 500;
+
+  std::bitset<MAX_PAGES> cleared;  // pages known not to contain the site
+  std::bitset<MAX_PAGES> fetched;  // pages downloaded during this update
+  std::string site_name;
+  uint32_t limit{0};
+  int32_t end_page{-1};  // last page of the dataset, once seen
+  size_t page{0};        // page to resume from
+  bool wrapped{false};
+  bool active{false};
+  bool deferred{false};  // stopped by the request budget; the next update resumes it
+  uint32_t pages_fetched{0};
+  uint32_t pages_refetched{0};
+
+  bool matches(const std::string &site, uint32_t page_limit) const {
+    return limit == page_limit && site_name == site;
+  }
+
+  void reset(const std::string &site, uint32_t page_limit) {
+    cleared.reset();
+    fetched.reset();
+    site_name = site;
+    limit = page_limit;
+    end_page = -1;
+    page = 0;
+    wrapped = false;
+    active = false;
+    deferred = false;
+    pages_fetched = 0;
+    pages_refetched = 0;
+  }
+
+  /// Forget which pages were cleared and where the data ends, so the next attempt reads
+  /// every page again. Download counts are kept, so re-reads show up as refetches.
+  void restart() {
+    cleared.reset();
+    end_page = -1;
+    page = 0;
+    wrapped = false;
+    active = false;
+    deferred = false;
+  }
+
+  /// True once every page of the dataset is known not to contain the site.
+  bool exhausted() const {
+    if (end_page < 0) return false;
+    for (int32_t p = 0; p <= end_page; p++) {
+      if (!cleared.test(p)) return false;
+    }
+    return true;
+  }
+};
+
+/// Cache validators from the last full response for one page of one query, with the
+/// snapshot publish time it carried, so a 304 can be matched back to the data it confirms.
+struct PageValidator {
+  static constexpr size_t ETAG_SIZE = 64;
+  static constexpr size_t DATE_SIZE = 32;
+
+  uint32_t key{0};
+  char etag[ETAG_SIZE]{};
+  char last_modified[DATE_SIZE]{};
+  char publish_time[DATE_SIZE]{};
+};
+
+/// Merges updates from every MoenvAQI instance that is due within a short window, plus
+/// instances whose next update is near, into a single streaming pass over the dataset.
+/// Each record's sitename is looked up in a small hash-sorted table and dispatched to the
+/// owning instance, which keeps its own publish path, retry schedule and on_error trigger.
+class FetchCoordinator {
+ public:
+  /// How long a queued update waits for other instances before the scan starts.
+  static constexpr uint32_t COALESCE_WINDOW_MS = 250;
+
+  /// Register an instance that may be brought forward to join another instance's scan.
+  void add(MoenvAQI *instance) { instances_.push_back(instance); }
+
+  /// Queue an instance for the next scan. Duplicate requests are merged.
+  void enqueue(MoenvAQI *instance);
+
+  /// Run scans until no instance is pending. Instances that cannot share a query
+  /// (different API key, language, limit or http_request) are scanned in separate passes.
+  void run();
+
+  /// Limit API requests made by all instances to max_requests per rolling window,
+  /// keeping reserve requests for first fetches and site changes.
+  void set_request_budget(uint32_t max_requests, uint32_t window, uint32_t reserve) {
+    budget_.configure(max_requests, window, reserve);
+  }
+  const RequestBudget &get_request_budget() const { return budget_; }
+
+  /// Whether a failed lookup may be retried with the budget that is left.
+  bool allow_retry(bool priority) const {
+    return !budget_.low() || (priority && budget_.remaining() > 0);
+  }
+
+ protected:
+  friend class testing::Probe;  // the host tests read the counters
+
+  static constexpr size_t MAX_VALIDATORS = 8;
+
+  struct Target {
+    uint32_t site_hash;
+    std::string site_name;
+    MoenvAQI *owner;
+    bool resolved;
+    bool success;
+  };
+
+  static bool same_query_(MoenvAQI *a, MoenvAQI *b);
+  void take_batch_();
+  void add_target_(MoenvAQI *instance);
+  bool is_target_(MoenvAQI *instance) const;
+  void scan_();
+  bool process_page_(HttpStreamAdapter &stream, int &records_count);
+  void resolve_probe_(const char *publish_time, const ScanProgress &progress);
+  void resolve_not_modified_(const char *publish_time, const ScanProgress &progress);
+  ScanProgress progress_(const HttpStreamAdapter &stream) const;
+  void resolve_exhausted_();
+  bool page_cleared_(size_t page) const;
+  void save_checkpoints_(size_t page, bool wrapped);
+  void sample_heap_();
+  void set_page_url_(size_t offset);
+  void start_prefetch_(MoenvAQI *leader, size_t page, size_t limit);
+  void cancel_prefetch_();
+  std::shared_ptr<http_request::HttpContainer> request_(MoenvAQI *leader, size_t offset, bool conditional);
+  void add_header_(const char *name, const char *value);
+  bool read_header_(http_request::HttpContainer *container, const char *name, char *buffer, size_t size);
+  uint32_t page_key_(size_t offset) const;
+  PageValidator *find_validator_(uint32_t key);
+  void save_validator_(uint32_t key, http_request::HttpContainer *container);
+
+  std::vector<MoenvAQI *> instances_;
+  std::vector<MoenvAQI *> pending_;
+  std::vector<Target> targets_;
+  size_t remaining_{0};
+
+  RequestBudget budget_;
+  uint32_t allowance_{0};
+  uint32_t pass_requests_{0};
+  bool budget_stopped_{false};  // the scan ended because the allowance was spent
+
+  // Reused across pages and passes so a steady-state update does not allocate
+  std::string url_;
+  size_t url_base_length_{0};
+  uint32_t url_base_hash_{0};
+  uint8_t stream_buffer_[HttpStreamAdapter::DEFAULT_BUFFER_SIZE];
+  JsonArena arena_;
+  JsonDocument doc_{&arena_};
+
+  // Current scan position
+  size_t offset_{0};
+  int32_t end_page_{-1};
+  uint32_t fetch_start_{0};
+  uint32_t fetch_bytes_{0};
+
+  // At most one page requested ahead of the one being parsed
+  std::shared_ptr<http_request::HttpContainer> prefetch_container_;
+  size_t prefetch_page_{0};
+  uint32_t prefetch_used_{0};
+  uint32_t prefetch_cancelled_{0};
+  uint32_t prefetch_skipped_{0};
+
+  // Conditional GET: validators for recently read pages, replaced round-robin
+  PageValidator validators_[MAX_VALIDATORS];
+  size_t next_validator_{0};
+  char page_publish_time_[PageValidator::DATE_SIZE]{};
+  std::list<http_request::Header> headers_;
+  std::list<http_request::Header> spare_headers_;
+  std::set<std::string> collect_headers_;
+  std::string header_value_;
+
+  // Worst cases observed under real network conditions, to size timeout and watchdog_timeout
+  uint32_t pass_stall_ms_{0};
+  uint32_t worst_pass_ms_{0};
+  uint32_t worst_stall_ms_{0};
+  uint32_t lowest_free_heap_{UINT32_MAX};
+};
+
+extern FetchCoordinator global_fetch_coordinator;  // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+}  // namespace moenv_aqi
+}  // namespace esphome
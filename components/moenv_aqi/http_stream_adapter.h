@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <cstring>
 #include <memory>
 #include <string>
@@ -9,6 +10,8 @@
 #include "esphome/core/application.h"
 #include "esphome/core/log.h"
 
+#include "trace.h"
+
 namespace esphome {
 namespace moenv_aqi {
 
@@ -21,6 +24,8 @@ class HttpStreamAdapter {
   static constexpr size_t MIN_BUFFER_SIZE = 64;
   static constexpr size_t MAX_BUFFER_SIZE = 4096;
   static constexpr size_t MAX_STRING_LENGTH = 1024;
+  static constexpr uint32_t FNV1A_OFFSET_BASIS = 2166136261UL;
+  static constexpr uint32_t FNV1A_PRIME = 16777619UL;
 
   explicit HttpStreamAdapter(std::shared_ptr<http_request::HttpContainer> container,
                              size_t buffer_size = DEFAULT_BUFFER_SIZE,
@@ -29,11 +34,20 @@ class HttpStreamAdapter {
         timeout_ms_(timeout_ms), last_data_time_(millis()) {
     if (buffer_size < MIN_BUFFER_SIZE) buffer_size = MIN_BUFFER_SIZE;
     if (buffer_size > MAX_BUFFER_SIZE) buffer_size = MAX_BUFFER_SIZE;
-    buf_.resize(buffer_size);
+    owned_buf_.resize(buffer_size);
+    buf_ = owned_buf_.data();
+    buf_size_ = buffer_size;
     read_pos_ = 0;
     write_pos_ = 0;
   }
 
+  /// Stream through a caller-owned buffer, so a page read does not allocate.
+  /// The buffer must outlive the adapter.
+  HttpStreamAdapter(std::shared_ptr<http_request::HttpContainer> container, uint8_t *buffer,
+                    size_t buffer_size, uint32_t timeout_ms)
+      : container_(std::move(container)), buf_(buffer), buf_size_(buffer_size), read_pos_(0), write_pos_(0),
+        total_bytes_read_(0), eof_(false), timeout_ms_(timeout_ms), last_data_time_(millis()) {}
+
   // Disable copy
   HttpStreamAdapter(const HttpStreamAdapter &) = delete;
   HttpStreamAdapter &operator=(const HttpStreamAdapter &) = delete;
@@ -41,18 +55,10 @@ class HttpStreamAdapter {
   /// Read one byte. Returns -1 on EOF.
   /// This method satisfies ArduinoJson's reader concept.
   int read() {
-    if (read_pos_ < write_pos_) {
-      uint8_t byte = buf_[read_pos_++];
-      total_bytes_read_++;
-      return byte;
-    }
+    if (read_pos_ < write_pos_) return consume_();
     if (eof_) return -1;
     if (!fill_buffer_()) return -1;
-    if (read_pos_ < write_pos_) {
-      uint8_t byte = buf_[read_pos_++];
-      total_bytes_read_++;
-      return byte;
-    }
+    if (read_pos_ < write_pos_) return consume_();
     return -1;
   }
 
@@ -140,32 +146,56 @@ class HttpStreamAdapter {
 
   size_t getBytesRead() const { return total_bytes_read_; }
 
+  /// True if the body ended on a read error or timeout rather than normal completion.
+  bool hasError() const { return error_; }
+
+  /// Longest time a single buffer fill waited for data from the connection.
+  uint32_t getMaxStallMs() const { return max_stall_ms_; }
+
+  /// Restart the running FNV-1a hash over consumed bytes.
+  void resetFingerprint() { fingerprint_ = FNV1A_OFFSET_BASIS; }
+
+  /// FNV-1a hash of every byte consumed since the last resetFingerprint().
+  uint32_t getFingerprint() const { return fingerprint_; }
+
   void drainBuffer() {
     read_pos_ = write_pos_;  // Discard buffered data
   }
 
  private:
+  int consume_() {
+    uint8_t byte = buf_[read_pos_++];
+    total_bytes_read_++;
+    fingerprint_ = (fingerprint_ ^ byte) * FNV1A_PRIME;
+    return byte;
+  }
+
   bool fill_buffer_() {
     // Only compact when remaining space is less than half the buffer
-    size_t space = buf_.size() - write_pos_;
-    if (space < buf_.size() / 2 && read_pos_ > 0) {
+    size_t space = buf_size_ - write_pos_;
+    if (space < buf_size_ / 2 && read_pos_ > 0) {
       size_t remaining = write_pos_ - read_pos_;
       if (remaining > 0) {
-        memmove(buf_.data(), buf_.data() + read_pos_, remaining);
+        memmove(buf_, buf_ + read_pos_, remaining);
       }
       write_pos_ = remaining;
       read_pos_ = 0;
-      space = buf_.size() - write_pos_;
+      space = buf_size_ - write_pos_;
     }
     if (space == 0) return write_pos_ > read_pos_;
 
+    MOENV_TRACE_SCOPE("read_wait");
+    const uint32_t wait_start = millis();
     while (true) {
       App.feed_wdt();
       yield();
-      int bytes_read = container_->read(buf_.data() + write_pos_, space);
+      int bytes_read = container_->read(buf_ + write_pos_, space);
       auto result = http_request::http_read_loop_result(
           bytes_read, last_data_time_, timeout_ms_,
           container_->is_read_complete());
+      if (result != http_request::HttpReadLoopResult::RETRY) {
+        max_stall_ms_ = std::max(max_stall_ms_, millis() - wait_start);
+      }
 
       switch (result) {
         case http_request::HttpReadLoopResult::DATA:
@@ -181,6 +211,7 @@ class HttpStreamAdapter {
           ESP_LOGW(TAG, "fill_buffer_ %s",
                    result == http_request::HttpReadLoopResult::ERROR ? "read error" : "timeout");
           eof_ = true;
+          error_ = true;
           return write_pos_ > read_pos_;
       }
       // unreachable, but satisfy compiler
@@ -189,13 +220,18 @@ class HttpStreamAdapter {
   }
 
   std::shared_ptr<http_request::HttpContainer> container_;
-  std::vector<uint8_t> buf_;
+  std::vector<uint8_t> owned_buf_;
+  uint8_t *buf_;
+  size_t buf_size_;
   size_t read_pos_;
   size_t write_pos_;
   size_t total_bytes_read_;
   bool eof_;
+  bool error_{false};
   uint32_t timeout_ms_;
   uint32_t last_data_time_;
+  uint32_t fingerprint_{FNV1A_OFFSET_BASIS};
+  uint32_t max_stall_ms_{0};
 };
 
 }  // namespace moenv_aqi
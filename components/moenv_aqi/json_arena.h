@@ -0,0 +1,94 @@
+#pragma once
+
+#include <ArduinoJson.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+namespace esphome {
+namespace moenv_aqi {
+
+/// Fixed bump allocator backing the coordinator's JsonDocument, so parsing a record
+/// does not touch the heap. Freed blocks are only reclaimed by reset(), which must be
+/// called while the document holds nothing (right after clear()). The most recent block
+/// is grown or released in place, which covers ArduinoJson's string building pattern.
+/// Requests that do not fit fall back to the heap and are counted.
+class JsonArena : public ArduinoJson::Allocator {
+ public:
+  static constexpr size_t SIZE = 4096;
+  static constexpr size_t ALIGN = 8;
+
+  void *allocate(size_t size) override {
+    const size_t total = HEADER + align_(size);
+    if (used_ + total > SIZE) {
+      overflows_++;
+      return malloc(size);
+    }
+    uint8_t *block = buf_ + used_;
+    *reinterpret_cast<size_t *>(block) = size;
+    last_ = used_;
+    used_ += total;
+    if (used_ > peak_) peak_ = used_;
+    return block + HEADER;
+  }
+
+  void deallocate(void *ptr) override {
+    if (ptr == nullptr) return;
+    if (!owns_(ptr)) {
+      free(ptr);
+      return;
+    }
+    if (is_last_(ptr)) used_ = last_;
+  }
+
+  void *reallocate(void *ptr, size_t new_size) override {
+    if (ptr == nullptr) return allocate(new_size);
+    if (!owns_(ptr)) return realloc(ptr, new_size);
+
+    size_t &old_size = *reinterpret_cast<size_t *>(static_cast<uint8_t *>(ptr) - HEADER);
+    if (is_last_(ptr) && last_ + HEADER + align_(new_size) <= SIZE) {
+      old_size = new_size;
+      used_ = last_ + HEADER + align_(new_size);
+      if (used_ > peak_) peak_ = used_;
+      return ptr;
+    }
+    if (new_size <= old_size) return ptr;
+
+    void *moved = allocate(new_size);
+    if (moved == nullptr) return nullptr;
+    memcpy(moved, ptr, old_size);
+    return moved;
+  }
+
+  /// Release every block at once. Heap fallbacks are freed through deallocate().
+  void reset() {
+    used_ = 0;
+    last_ = 0;
+  }
+
+  size_t get_peak() const { return peak_; }
+  uint32_t get_overflows() const { return overflows_; }
+
+ protected:
+  static constexpr size_t HEADER = ALIGN;
+
+  static size_t align_(size_t size) { return (size + ALIGN - 1) & ~(ALIGN - 1); }
+
+  bool owns_(const void *ptr) const {
+    const uint8_t *p = static_cast<const uint8_t *>(ptr);
+    return p >= buf_ && p < buf_ + SIZE;
+  }
+
+  bool is_last_(const void *ptr) const { return used_ > 0 && static_cast<const uint8_t *>(ptr) == buf_ + last_ + HEADER; }
+
+  alignas(ALIGN) uint8_t buf_[SIZE];
+  size_t used_{0};
+  size_t last_{0};
+  size_t peak_{0};
+  uint32_t overflows_{0};
+};
+
+}  // namespace moenv_aqi
+}  // namespace esphome
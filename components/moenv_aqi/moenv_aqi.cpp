@@ -12,12 +12,12 @@
 #include "esphome/core/helpers.h"
 #include "esphome/core/time.h"
 
+#include "trace.h"
+
 namespace esphome {
 namespace moenv_aqi {
 
-static constexpr size_t MAX_RECORDS_CHECKED = 500;
-static constexpr size_t URL_BASE_RESERVE_SIZE = 256;
-static constexpr size_t URL_OFFSET_RESERVE_SIZE = 20;
+static constexpr uint32_t MAX_RETRY_DELAY_MS = 30000;
 uint32_t global_moenv_aqi_id = 1911044085ULL;
 
 // Setup priority
@@ -32,7 +32,14 @@ void MoenvAQI::setup() {
   if (this->pref_.load(&last_successful_offset_)) {
     ESP_LOGD(TAG, "Loaded last_successful_offset_: %u", last_successful_offset_);
   }
+  this->history_pref_ = global_preferences->make_preference<History::Store>(fnv1_hash(object_id + "_history"));
+  History::Store store{};
+  if (this->history_pref_.load(&store)) {
+    this->history_.restore(store);
+    ESP_LOGD(TAG, "Loaded %u history samples", this->history_.size());
+  }
   global_moenv_aqi_id++;
+  global_fetch_coordinator.add(this);
 }
 
 // Reset site data
@@ -40,6 +47,10 @@ void MoenvAQI::reset_site_data_() {
   ESP_LOGD(TAG, "Site name changed, resetting data and offsets");
   last_successful_offset_ = 0;
   data_ = Record();
+  record_fingerprint_ = 0;
+  published_valid_ = false;
+  history_.clear();
+  this->history_pref_.save(&this->history_.get_store());
   if (this->publish_time_) this->publish_time_->publish_state("");
   if (this->site_id_) this->site_id_->publish_state(this->data_.site_id);
   if (this->longitude_) this->longitude_->publish_state(this->data_.longitude);
@@ -50,11 +61,24 @@ void MoenvAQI::reset_site_data_() {
 
 // Periodic update
 void MoenvAQI::update() {
+  const uint32_t now = millis();
+  const uint32_t elapsed = now - this->last_update_ms_;
+  this->last_update_ms_ = now;
+  const bool served_early = this->served_early_;
+  this->served_early_ = false;
   if (!validate_config_()) {
     ESP_LOGE(TAG, "Configuration validation failed");
     return;
   }
 
+  // Only the scheduled update a shared scan brought forward is skipped. One that comes
+  // sooner was requested by hand, and a changed site or limit has not been fetched yet.
+  const bool scheduled = elapsed + FetchCoordinator::COALESCE_WINDOW_MS >= this->get_update_interval();
+  if (served_early && scheduled && site_name_.value() == last_site_name_ && limit_.value() == last_limit_) {
+    ESP_LOGD(TAG, "Already refreshed by a shared scan, skipping this update");
+    return;
+  }
+
   if (limit_.value() != last_limit_ && last_limit_ != 0) {
     ESP_LOGD(TAG, "Limit changed, resetting last_successful_offset_");
     last_successful_offset_ = 0;
@@ -76,11 +100,26 @@ void MoenvAQI::dump_config() {
   ESP_LOGCONFIG(TAG, "MOENV AQI:");
   ESP_LOGCONFIG(TAG, "  API Key: %s", api_key_.value().empty() ? "not set" : "set");
   ESP_LOGCONFIG(TAG, "  Site Name: %s", site_name_.value().c_str());
+  ESP_LOGCONFIG(TAG, "  Endpoint: %s", endpoint_.value().c_str());
   ESP_LOGCONFIG(TAG, "  Language: %s", language_.value().c_str());
   ESP_LOGCONFIG(TAG, "  Limit: %u", limit_.value());
   ESP_LOGCONFIG(TAG, "  Sensor Expired: %u minutes", sensor_expiry_.value() / 1000 / 60);
   ESP_LOGCONFIG(TAG, "  Retry Count: %u", retry_count_.value());
-  ESP_LOGCONFIG(TAG, "  Retry Delay: %u ms", retry_delay_.value());
+  ESP_LOGCONFIG(TAG, "  Retry Delay: %u ms (worst-case total backoff %u ms)", retry_delay_.value(),
+                worst_case_backoff_());
+  ESP_LOGCONFIG(TAG, "  Probe Publish Time: %s", YESNO(probe_publish_time_.value()));
+  ESP_LOGCONFIG(TAG, "  Prefetch: %s", YESNO(prefetch_.value()));
+  const RequestBudget &budget = global_fetch_coordinator.get_request_budget();
+  if (budget.enabled()) {
+    ESP_LOGCONFIG(TAG, "  Request Budget: %u per %u s, reserve %u, %u left", budget.get_max_requests(),
+                  budget.get_window(), budget.get_reserve(), budget.remaining());
+  }
+  ESP_LOGCONFIG(TAG, "  History: %u/%u hours", history_.size(), history_.get_window());
+  ESP_LOGCONFIG(TAG, "  Unchanged Records Skipped: %u/%u", fingerprint_skips_, fingerprint_checks_);
+  ESP_LOGCONFIG(TAG, "  Pages Re-downloaded After Retries: %u", pages_refetched_total_);
+  ESP_LOGCONFIG(TAG, "  Unchanged Dataset Probes: %u (avoided %u bytes, %u ms)", probe_hits_,
+                static_cast<uint32_t>(probe_bytes_saved_), static_cast<uint32_t>(probe_ms_saved_));
+  ESP_LOGCONFIG(TAG, "  Not Modified Responses: %u", not_modified_hits_);
   LOG_UPDATE_INTERVAL(this);
 }
 
@@ -97,6 +136,11 @@ bool MoenvAQI::validate_config_() {
     valid = false;
   }
 
+  if (endpoint_.value().empty()) {
+    ESP_LOGE(TAG, "Endpoint not set");
+    valid = false;
+  }
+
   if (language_.value().empty()) {
     ESP_LOGE(TAG, "Language not set");
     valid = false;
@@ -110,8 +154,10 @@ bool MoenvAQI::validate_config_() {
   return valid;
 }
 
-// Send HTTP request
-bool MoenvAQI::send_request_() {
+// Check preconditions and reset per-fetch state before joining a shared scan
+bool MoenvAQI::prepare_fetch_() {
+  this->record_unchanged_ = false;
+
   if (!this->rtc_->now().is_valid()) {
     ESP_LOGW(TAG, "RTC is not valid");
     return false;
@@ -122,122 +168,141 @@ bool MoenvAQI::send_request_() {
     return false;
   }
 
-  const size_t start_offset = last_successful_offset_;
-  size_t offset = start_offset;
-  size_t limit = limit_.value();
-  bool wrapped = false;
-
-  std::string limit_parm;
-  limit_parm.reserve(32);
-  if (limit > 0) {
-    limit_parm = "&limit=";
-    limit_parm += std::to_string(limit);
+  // A checkpoint only carries over between retries of the same lookup, or to the next
+  // update when the request budget stopped the scan
+  const std::string &site_name = site_name_.value();
+  if ((this->attempt_ == 0 && !this->checkpoint_.deferred) || !this->checkpoint_.matches(site_name, limit_.value())) {
+    this->checkpoint_.reset(site_name, limit_.value());
   }
 
-  bool found = false;
-  Record record{};
-  int records_count = 0;
+  ESP_LOGD(TAG, "Looking for site: %s", site_name.c_str());
+  return true;
+}
 
-  std::string url_base;
-  url_base.reserve(URL_BASE_RESERVE_SIZE);
-  url_base = "https://data.moenv.gov.tw/api/v2/aqx_p_432?language=";
-  url_base += language_.value();
-  url_base += "&api_key=";
-  url_base += api_key_.value();
-  url_base += limit_parm;
+// Whether a snapshot with this publishtime is the one data_ already holds
+bool MoenvAQI::snapshot_matches_(const char *publish_time) {
+  return !this->data_.publish_time.empty() && this->data_.publish_time == publish_time;
+}
 
-  size_t total_checked = 0;
-  while (!found) {
-    if (total_checked >= MAX_RECORDS_CHECKED) {
-      ESP_LOGW(TAG, "Safeguard: checked over %u records, aborting search.", MAX_RECORDS_CHECKED);
-      break;
-    }
-    total_checked += limit;
-    std::string url;
-    url.reserve(url_base.length() + URL_OFFSET_RESERVE_SIZE);
-    url = url_base;
-    url += "&offset=";
-    url += std::to_string(offset);
-
-    ESP_LOGD(TAG, "Sending query: %s", url.c_str());
-    ESP_LOGD(TAG, "Before request: free heap:%u, max block:%u",
-             esp_get_free_heap_size(),
-             heap_caps_get_largest_free_block(MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL));
-    App.feed_wdt();
-
-    auto container = this->http_request_->get(url);
-
-    ESP_LOGD(TAG, "After request: free heap:%u, max block:%u",
-             esp_get_free_heap_size(),
-             heap_caps_get_largest_free_block(MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL));
-
-    if (container == nullptr) {
-      ESP_LOGE(TAG, "HTTP request failed: no response container");
-      return false;
-    }
+bool MoenvAQI::probe_matches_(const char *publish_time) {
+  return probe_publish_time_.value() && this->snapshot_matches_(publish_time);
+}
 
-    if (container->status_code != 200) {
-      ESP_LOGE(TAG, "HTTP request failed with code: %d", container->status_code);
-      container->end();
-      return false;
-    }
+// The dataset has not been republished; keep data_ and report what the probe avoided
+void MoenvAQI::handle_probe_hit_(const ScanProgress &progress) {
+  const uint32_t bytes_avoided = this->last_fetch_bytes_ > progress.bytes ? this->last_fetch_bytes_ - progress.bytes : 0;
+  const uint32_t ms_avoided = this->last_fetch_ms_ > progress.elapsed_ms ? this->last_fetch_ms_ - progress.elapsed_ms : 0;
+  this->record_unchanged_ = true;
+  this->probe_hits_++;
+  this->probe_bytes_saved_ += bytes_avoided;
+  this->probe_ms_saved_ += ms_avoided;
+  ESP_LOGI(TAG, "Dataset not republished since %s, stopped after %u bytes (avoided ~%u bytes, ~%u ms)",
+           this->data_.publish_time.c_str(), progress.bytes, bytes_avoided, ms_avoided);
+}
 
-    App.feed_wdt();
-    ESP_LOGD(TAG, "Looking for site: %s", site_name_.value().c_str());
-
-    HttpStreamAdapter stream(container, 1024, this->http_request_->get_timeout());
-    bool result = process_response_(stream, record, records_count);
-    ESP_LOGD(TAG, "Processed %zu bytes, records_count: %d", stream.getBytesRead(), records_count);
-
-    container->end();
-
-    ESP_LOGD(TAG, "After json parse: free heap:%u, max block:%u",
-             esp_get_free_heap_size(),
-             heap_caps_get_largest_free_block(MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL));
-
-    if (result) {
-      found = true;
-      this->last_successful_offset_ = offset;
-      if (check_changes_(record)) {
-        this->data_ = record;
-        if (validate_record_()) {
-          ESP_LOGD(TAG, "Triggering on_data_change automation.");
-          this->on_data_change_trigger_.trigger(this->data_);
-        } else {
-          ESP_LOGW(TAG, "Record validation failed.");
-          return false;
-        }
-      } else {
-        ESP_LOGD(TAG, "Data has not changed since last update.");
-      }
-    } else {
-      ESP_LOGD(TAG, "Site '%s' not found at offset %u (records_count: %d, limit: %u)",
-               site_name_.value().c_str(), offset, records_count, limit);
-
-      if (records_count == 0 || records_count < (int)limit) {
-        if (wrapped) {
-          ESP_LOGW(TAG, "Site '%s' not found after full scan", site_name_.value().c_str());
-          break;
-        }
-        ESP_LOGD(TAG, "Reached end of data, wrapping around to offset 0");
-        offset = 0;
-        wrapped = true;
-      } else {
-        offset += limit;
-      }
+// The server answered 304 for a page of the snapshot data_ came from; keep data_
+void MoenvAQI::handle_not_modified_(const ScanProgress &progress) {
+  this->record_unchanged_ = true;
+  this->not_modified_hits_++;
+  ESP_LOGI(TAG, "Dataset not modified since %s, confirmed by 304 after %u ms", this->data_.publish_time.c_str(),
+           progress.elapsed_ms);
+}
 
-      if (wrapped && offset >= start_offset && start_offset > 0) {
-        ESP_LOGW(TAG, "Completed wrap-around scan, site '%s' not found", site_name_.value().c_str());
-        break;
-      }
-    }
+// Handle the target site's record from a shared scan; returns false if it was rejected
+bool MoenvAQI::handle_record_(JsonDocument &doc, uint32_t fingerprint, const ScanProgress &progress) {
+  this->last_successful_offset_ = progress.offset;
+  // Remember what a full lookup costs so probe hits can report the savings
+  this->last_fetch_bytes_ = progress.bytes;
+  this->last_fetch_ms_ = progress.elapsed_ms;
+
+  // Identical raw bytes mean an identical record; skip field mapping entirely
+  this->fingerprint_checks_++;
+  if (fingerprint == this->record_fingerprint_ && !this->data_.publish_time.empty()) {
+    this->record_unchanged_ = true;
+    this->fingerprint_skips_++;
+    this->saved_us_ += this->record_cost_us_;
+    ESP_LOGD(TAG, "Record fingerprint unchanged, skipped mapping and publishing (%u/%u skipped, ~%u us saved)",
+             this->fingerprint_skips_, this->fingerprint_checks_, static_cast<uint32_t>(this->saved_us_));
+    return true;
+  }
+
+  Record &record = this->scratch_;
+  record.clear();
+  {
+    MOENV_TRACE_SCOPE("map");
+    if (!map_record_(doc, record)) return false;
+  }
+
+  if (!check_changes_(record)) {
+    // Same record in different bytes; remember these bytes so the next copy is skipped
+    this->record_fingerprint_ = fingerprint;
+    ESP_LOGD(TAG, "Data has not changed since last update.");
+    return true;
   }
-  return found;
+
+  this->data_ = record;
+  this->record_fingerprint_ = fingerprint;
+  if (!validate_record_()) {
+    ESP_LOGW(TAG, "Record validation failed.");
+    return false;
+  }
+  this->record_history_();
+  ESP_LOGD(TAG, "Triggering on_data_change automation.");
+  this->on_data_change_trigger_.trigger(this->data_);
+  return true;
 }
 
-// Non-blocking retry with exponential backoff
+// Queue this instance for the next shared scan
 void MoenvAQI::try_send_request_(uint32_t attempt) {
-  if (this->send_request_()) {
+  this->attempt_ = attempt;
+  global_fetch_coordinator.enqueue(this);
+  // Wait briefly so instances updated around the same time share the scan
+  this->set_timeout("moenv_fetch", FetchCoordinator::COALESCE_WINDOW_MS, []() { global_fetch_coordinator.run(); });
+}
+
+// Whether this instance's next update is close enough to serve it from a scan starting now.
+// Instances start their intervals at random offsets, so without this they rarely coincide.
+bool MoenvAQI::join_early_() {
+  const uint32_t interval = this->get_update_interval();
+  if (this->retry_in_progress_ || this->served_early_ || this->last_update_ms_ == 0 ||
+      interval == SCHEDULER_DONT_RUN) {
+    return false;
+  }
+  // Only join within the second half of the interval, so the data is never older than usual
+  const uint32_t elapsed = millis() - this->last_update_ms_;
+  if (elapsed < interval / 2) return false;
+  // A site or limit change needs update() to reset state before fetching
+  if (!this->validate_config_() || site_name_.value() != last_site_name_ || limit_.value() != last_limit_) {
+    return false;
+  }
+
+  ESP_LOGD(TAG, "Joining shared scan for %s, %u ms ahead of its update", last_site_name_.c_str(),
+           elapsed < interval ? interval - elapsed : 0);
+  this->attempt_ = 0;
+  this->served_early_ = true;
+  return true;
+}
+
+// Delay before retry number attempt + 1, with exponential backoff and up to 1s of jitter
+static uint32_t retry_backoff(uint32_t retry_delay, uint32_t attempt, uint32_t jitter) {
+  uint32_t backoff_delay = retry_delay * (1 << attempt);
+  return std::min(backoff_delay + jitter, static_cast<uint32_t>(MAX_RETRY_DELAY_MS));
+}
+
+// Longest time a full retry sequence can spend waiting between attempts
+uint32_t MoenvAQI::worst_case_backoff_() {
+  uint32_t total = 0;
+  for (uint32_t attempt = 0; attempt < retry_count_.value(); attempt++) {
+    total += retry_backoff(retry_delay_.value(), attempt, 999);
+  }
+  return total;
+}
+
+// Apply the outcome of a scan, with non-blocking retry and exponential backoff
+void MoenvAQI::finish_fetch_(bool success) {
+  const uint32_t attempt = this->attempt_;
+  this->publish_request_budget_();
+  if (success) {
     this->retry_in_progress_ = false;
     this->status_clear_warning();
 
@@ -250,6 +315,11 @@ void MoenvAQI::try_send_request_(uint32_t attempt) {
       }
     }
 
+    this->pages_refetched_total_ += this->checkpoint_.pages_refetched;
+    ESP_LOGD(TAG, "Lookup fetched %u page(s), %u re-downloaded across retries", this->checkpoint_.pages_fetched,
+             this->checkpoint_.pages_refetched);
+    this->checkpoint_.reset(site_name_.value(), limit_.value());
+
     ESP_LOGD(TAG, "Saving last_successful_offset_: %u", this->last_successful_offset_);
     this->pref_.save(&this->last_successful_offset_);
     this->publish_states_();
@@ -257,11 +327,10 @@ void MoenvAQI::try_send_request_(uint32_t attempt) {
   }
 
   uint32_t retry_count = retry_count_.value();
-  if (attempt < retry_count) {
-    uint32_t retry_delay = retry_delay_.value();
-    uint32_t backoff_delay = retry_delay * (1 << attempt);
-    uint32_t jitter = esp_random() % 1000;
-    uint32_t total_delay = std::min(backoff_delay + jitter, static_cast<uint32_t>(30000));
+  if (attempt < retry_count && !global_fetch_coordinator.allow_retry(this->needs_priority_())) {
+    ESP_LOGW(TAG, "Request budget low, not retrying");
+  } else if (attempt < retry_count) {
+    uint32_t total_delay = retry_backoff(retry_delay_.value(), attempt, esp_random() % 1000);
 
     ESP_LOGW(TAG, "Request failed (attempt %u/%u), retrying in %u ms",
              attempt + 1, retry_count + 1, total_delay);
@@ -276,6 +345,7 @@ void MoenvAQI::try_send_request_(uint32_t attempt) {
   // Final failure
   this->retry_in_progress_ = false;
   this->last_successful_offset_ = 0;
+  this->checkpoint_.reset(site_name_.value(), limit_.value());
   this->status_set_warning();
   this->on_error_trigger_.trigger();
 
@@ -286,113 +356,119 @@ void MoenvAQI::try_send_request_(uint32_t attempt) {
     }
   }
 
-  ESP_LOGE(TAG, "Request failed after %u attempts", retry_count_.value() + 1);
+  ESP_LOGE(TAG, "Request failed after %u attempts", attempt + 1);
   ESP_LOGD(TAG, "Saving last_successful_offset_: %u", this->last_successful_offset_);
   this->pref_.save(&this->last_successful_offset_);
   this->publish_states_();
 }
 
-// Process HTTP response
-bool MoenvAQI::process_response_(HttpStreamAdapter &stream, Record &record, int &records_count) {
-  records_count = 0;
+// The request budget is down to its reserve; keep data_ and wait for the next update
+void MoenvAQI::skip_fetch_() {
+  ESP_LOGW(TAG, "Skipping update of %s to save request budget", site_name_.value().c_str());
+  this->retry_in_progress_ = false;
+  this->record_unchanged_ = true;
+  this->publish_request_budget_();
+  // Still lets data_ expire on schedule
+  this->publish_states_();
+}
 
-  if (!stream.find("[")) {
-    ESP_LOGE(TAG, "Could not find array start '['");
-    return false;
+void MoenvAQI::publish_request_budget_() {
+  const RequestBudget &budget = global_fetch_coordinator.get_request_budget();
+  if (this->request_budget_remaining_ && budget.enabled()) {
+    this->request_budget_remaining_->publish_state(budget.remaining());
   }
+}
 
-  const std::string target_site_name = site_name_.value();
-
-  JsonDocument doc;
-
-  // Iterate through each record in the array
-  bool found = false;
-  do {
-    App.feed_wdt();
-    DeserializationError error = deserializeJson(doc, stream);
-    if (error) {
-      ESP_LOGE(TAG, "deserializeJson() failed: %s", error.c_str());
-      continue;  // Skip to the next record
-    }
-
-    records_count++;  // Count successfully parsed records
-
-    // Extract the sitename
-    JsonVariant sitename_json = doc["sitename"];
-    if (!sitename_json) {
-      ESP_LOGW(TAG, "Could not find 'sitename' field, skipping record");
-      continue;
-    }
-    if (sitename_json.isNull()) {
-      ESP_LOGW(TAG, "'sitename' field is null, skipping record");
-      continue;
-    }
+// Copy a string field into the record's existing buffer; other values keep their JSON text
+static void assign_string(std::string &field, JsonVariant &value) {
+  const char *str = value.as<const char *>();
+  if (str != nullptr) {
+    field.assign(str);
+  } else {
+    field = value.as<std::string>();
+  }
+}
 
-    const std::string sitename = sitename_json.as<std::string>();
-    ESP_LOGV(TAG, "sitename: %s", sitename.c_str());
-
-    // Check if this is the target site
-    if (sitename == target_site_name) {
-      ESP_LOGD(TAG, "Found target site: %s", target_site_name.c_str());
-
-      static const std::array mappings{
-          FieldMapping{FIELD_SITENAME, true, [](Record &r, JsonVariant &v) { r.site_name = v.as<std::string>(); }},
-          FieldMapping{FIELD_COUNTY, false, [](Record &r, JsonVariant &v) { r.county = v.as<std::string>(); }},
-          FieldMapping{FIELD_AQI, true, [](Record &r, JsonVariant &v) { r.aqi = v.as<int>(); }},
-          FieldMapping{FIELD_POLLUTANT, false, [](Record &r, JsonVariant &v) { r.pollutant = v.as<std::string>(); }},
-          FieldMapping{FIELD_STATUS, false, [](Record &r, JsonVariant &v) { r.status = v.as<std::string>(); }},
-          FieldMapping{FIELD_SO2, false, [](Record &r, JsonVariant &v) { r.so2 = v.as<float>(); }},
-          FieldMapping{FIELD_CO, false, [](Record &r, JsonVariant &v) { r.co = v.as<float>(); }},
-          FieldMapping{FIELD_O3, false, [](Record &r, JsonVariant &v) { r.o3 = v.as<int>(); }},
-          FieldMapping{FIELD_O3_8HR, false, [](Record &r, JsonVariant &v) { r.o3_8hr = v.as<int>(); }},
-          FieldMapping{FIELD_PM10, false, [](Record &r, JsonVariant &v) { r.pm10 = v.as<int>(); }},
-          FieldMapping{FIELD_PM25, false, [](Record &r, JsonVariant &v) { r.pm2_5 = v.as<int>(); }},
-          FieldMapping{FIELD_NO2, false, [](Record &r, JsonVariant &v) { r.no2 = v.as<int>(); }},
-          FieldMapping{FIELD_NOX, false, [](Record &r, JsonVariant &v) { r.nox = v.as<int>(); }},
-          FieldMapping{FIELD_NO, false, [](Record &r, JsonVariant &v) { r.no = v.as<float>(); }},
-          FieldMapping{FIELD_WIND_SPEED, false, [](Record &r, JsonVariant &v) { r.wind_speed = v.as<float>(); }},
-          FieldMapping{FIELD_WIND_DIREC, false, [](Record &r, JsonVariant &v) { r.wind_direc = v.as<int>(); }},
-          FieldMapping{FIELD_PUBLISH_TIME, true, [](Record &r, JsonVariant &v) { r.publish_time = v.as<std::string>(); }},
-          FieldMapping{FIELD_CO_8HR, false, [](Record &r, JsonVariant &v) { r.co_8hr = v.as<float>(); }},
-          FieldMapping{FIELD_PM25_AVG, false, [](Record &r, JsonVariant &v) { r.pm2_5_avg = v.as<float>(); }},
-          FieldMapping{FIELD_PM10_AVG, false, [](Record &r, JsonVariant &v) { r.pm10_avg = v.as<int>(); }},
-          FieldMapping{FIELD_SO2_AVG, false, [](Record &r, JsonVariant &v) { r.so2_avg = v.as<float>(); }},
-          FieldMapping{FIELD_LONGITUDE, false, [](Record &r, JsonVariant &v) { r.longitude = v.as<double>(); }},
-          FieldMapping{FIELD_LATITUDE, false, [](Record &r, JsonVariant &v) { r.latitude = v.as<double>(); }},
-          FieldMapping{FIELD_SITEID, false, [](Record &r, JsonVariant &v) { r.site_id = v.as<int>(); }},
-      };
-
-      for (const auto &m : mappings) {
-        JsonVariant val = doc[m.key];
-        if (val.isNull()) {
-          if (m.required) {
-            ESP_LOGE(TAG, "Required field '%s' missing or null, record invalid", m.key.data());
-            return false;
-          }
-          continue;
-        }
-        m.setter(record, val);
-      }
+// Map the target site's JSON record into a Record; returns false if it is invalid
+bool MoenvAQI::map_record_(JsonDocument &doc, Record &record) {
+  const uint32_t map_start = micros();
+
+  static const std::array mappings{
+      FieldMapping{FIELD_SITENAME, true, [](Record &r, JsonVariant &v) { assign_string(r.site_name, v); }},
+      FieldMapping{FIELD_COUNTY, false, [](Record &r, JsonVariant &v) { assign_string(r.county, v); }},
+      FieldMapping{FIELD_AQI, true, [](Record &r, JsonVariant &v) { r.aqi = v.as<int>(); }},
+      FieldMapping{FIELD_POLLUTANT, false, [](Record &r, JsonVariant &v) { assign_string(r.pollutant, v); }},
+      FieldMapping{FIELD_STATUS, false, [](Record &r, JsonVariant &v) { assign_string(r.status, v); }},
+      FieldMapping{FIELD_SO2, false, [](Record &r, JsonVariant &v) { r.so2 = v.as<float>(); }},
+      FieldMapping{FIELD_CO, false, [](Record &r, JsonVariant &v) { r.co = v.as<float>(); }},
+      FieldMapping{FIELD_O3, false, [](Record &r, JsonVariant &v) { r.o3 = v.as<int>(); }},
+      FieldMapping{FIELD_O3_8HR, false, [](Record &r, JsonVariant &v) { r.o3_8hr = v.as<int>(); }},
+      FieldMapping{FIELD_PM10, false, [](Record &r, JsonVariant &v) { r.pm10 = v.as<int>(); }},
+      FieldMapping{FIELD_PM25, false, [](Record &r, JsonVariant &v) { r.pm2_5 = v.as<int>(); }},
+      FieldMapping{FIELD_NO2, false, [](Record &r, JsonVariant &v) { r.no2 = v.as<int>(); }},
+      FieldMapping{FIELD_NOX, false, [](Record &r, JsonVariant &v) { r.nox = v.as<int>(); }},
+      FieldMapping{FIELD_NO, false, [](Record &r, JsonVariant &v) { r.no = v.as<float>(); }},
+      FieldMapping{FIELD_WIND_SPEED, false, [](Record &r, JsonVariant &v) { r.wind_speed = v.as<float>(); }},
+      FieldMapping{FIELD_WIND_DIREC, false, [](Record &r, JsonVariant &v) { r.wind_direc = v.as<int>(); }},
+      FieldMapping{FIELD_PUBLISH_TIME, true, [](Record &r, JsonVariant &v) { assign_string(r.publish_time, v); }},
+      FieldMapping{FIELD_CO_8HR, false, [](Record &r, JsonVariant &v) { r.co_8hr = v.as<float>(); }},
+      FieldMapping{FIELD_PM25_AVG, false, [](Record &r, JsonVariant &v) { r.pm2_5_avg = v.as<float>(); }},
+      FieldMapping{FIELD_PM10_AVG, false, [](Record &r, JsonVariant &v) { r.pm10_avg = v.as<int>(); }},
+      FieldMapping{FIELD_SO2_AVG, false, [](Record &r, JsonVariant &v) { r.so2_avg = v.as<float>(); }},
+      FieldMapping{FIELD_LONGITUDE, false, [](Record &r, JsonVariant &v) { r.longitude = v.as<double>(); }},
+      FieldMapping{FIELD_LATITUDE, false, [](Record &r, JsonVariant &v) { r.latitude = v.as<double>(); }},
+      FieldMapping{FIELD_SITEID, false, [](Record &r, JsonVariant &v) { r.site_id = v.as<int>(); }},
+  };
 
-      if (record.aqi < 0 || record.aqi > 500) {
-        ESP_LOGE(TAG, "Invalid AQI value: %d", record.aqi);
+  for (const auto &m : mappings) {
+    JsonVariant val = doc[m.key];
+    if (val.isNull()) {
+      if (m.required) {
+        ESP_LOGE(TAG, "Required field '%s' missing or null, record invalid", m.key.data());
         return false;
       }
-      if (record.latitude < -90.0 || record.latitude > 90.0 || record.longitude < -180.0 || record.longitude > 180.0) {
-        ESP_LOGE(TAG, "Invalid coordinates: lat=%.6f lon=%.6f", record.latitude, record.longitude);
-        return false;
-      }
-      return true;
+      continue;
     }
-  } while (!found && stream.findUntil(",", "]"));
-  return found;
+    m.setter(record, val);
+  }
+
+  if (record.aqi < 0 || record.aqi > 500) {
+    ESP_LOGE(TAG, "Invalid AQI value: %d", record.aqi);
+    return false;
+  }
+  if (record.latitude < -90.0 || record.latitude > 90.0 || record.longitude < -180.0 || record.longitude > 180.0) {
+    ESP_LOGE(TAG, "Invalid coordinates: lat=%.6f lon=%.6f", record.latitude, record.longitude);
+    return false;
+  }
+  this->map_us_ = micros() - map_start;
+  return true;
 }
 
 // Compare new data with stored data; return true if they differ
 bool MoenvAQI::check_changes_(const Record &new_data) { return !(this->data_ == new_data); }
 
 // Validate the record based on the current time and valid duration
-bool MoenvAQI::validate_record_() { return this->data_.validate(this->rtc_->now(), this->sensor_expiry_.value() / 1000 / 60); }
+bool MoenvAQI::validate_record_() {
+  MOENV_TRACE_SCOPE("validate");
+  return this->data_.validate(this->rtc_->now(), this->sensor_expiry_.value() / 1000 / 60);
+}
+
+// Append the current record to the hourly history and persist it
+void MoenvAQI::record_history_() {
+  time_t publish_ts;
+  if (!this->data_.parse_publish_time(publish_ts)) return;
+
+  HistorySample sample{};
+  sample.hour = static_cast<uint32_t>(publish_ts / 3600);
+  sample.aqi = static_cast<uint16_t>(std::clamp(this->data_.aqi, 0, 0xFFFF));
+  sample.pm2_5 = static_cast<uint16_t>(std::clamp(this->data_.pm2_5, 0, 0xFFFF));
+  if (!this->history_.add(sample)) {
+    ESP_LOGV(TAG, "History already has a sample for this hour");
+    return;
+  }
+  ESP_LOGD(TAG, "Recorded history sample (%u/%u)", this->history_.size(), this->history_.get_window());
+  this->history_pref_.save(&this->history_.get_store());
+}
 
 // Publish all sensor and text sensor states
 void MoenvAQI::publish_states_() {
@@ -405,8 +481,18 @@ void MoenvAQI::publish_states_() {
 
   const bool valid = validate_record_();
 
+  // An unchanged record only needs republishing when it has just expired
+  if (this->record_unchanged_ && valid == this->published_valid_) {
+    ESP_LOGV(TAG, "Record unchanged, skipping sensor publish");
+    return;
+  }
+  this->published_valid_ = valid;
+  const uint32_t publish_start = micros();
+
   auto publish = [valid](sensor::Sensor *s, float value) {
-    if (s) s->publish_state(valid ? value : NAN);
+    if (!s) return;
+    MOENV_TRACE_SCOPE("publish_state");
+    s->publish_state(valid ? value : NAN);
   };
 
   publish(this->aqi_, this->data_.aqi);
@@ -426,6 +512,17 @@ void MoenvAQI::publish_states_() {
   publish(this->wind_direc_, this->data_.wind_direc);
   publish(this->pm10_avg_, this->data_.pm10_avg);
 
+  const HistoryStats aqi_stats = this->history_.aqi_stats();
+  publish(this->aqi_min_, aqi_stats.min);
+  publish(this->aqi_max_, aqi_stats.max);
+  publish(this->aqi_mean_, aqi_stats.mean);
+  publish(this->aqi_trend_, aqi_stats.slope);
+  const HistoryStats pm2_5_stats = this->history_.pm2_5_stats();
+  publish(this->pm2_5_min_, pm2_5_stats.min);
+  publish(this->pm2_5_max_, pm2_5_stats.max);
+  publish(this->pm2_5_mean_, pm2_5_stats.mean);
+  publish(this->pm2_5_trend_, pm2_5_stats.slope);
+
   if (this->pollutant_) this->pollutant_->publish_state(valid ? this->data_.pollutant : "");
   if (this->status_) this->status_->publish_state(valid ? this->data_.status : "");
 
@@ -437,6 +534,10 @@ void MoenvAQI::publish_states_() {
     if (this->current_site_name_) this->current_site_name_->publish_state(this->data_.site_name);
     if (this->county_) this->county_->publish_state(this->data_.county);
   }
+
+  if (!this->record_unchanged_) {
+    this->record_cost_us_ = this->map_us_ + (micros() - publish_start);
+  }
 }
 
 }  // namespace moenv_aqi
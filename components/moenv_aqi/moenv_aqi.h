@@ -12,7 +12,10 @@
 #include "esphome/core/preferences.h"
 #include "esphome/core/time.h"
 
+#include "fetch_coordinator.h"
 #include "http_stream_adapter.h"
+#include "record_history.h"
+#include "templatable_string.h"
 
 namespace esphome {
 namespace moenv_aqi {
@@ -82,12 +85,8 @@ struct Record {
   double latitude{0.0};
   int site_id{0};
 
-  bool validate(esphome::ESPTime time, size_t minutes) const {
-    if (!time.is_valid()) {
-      ESP_LOGW(TAG, "Invalid time");
-      return false;
-    }
-
+  /// Parse publish_time as local time into a UNIX timestamp.
+  bool parse_publish_time(time_t &timestamp) const {
     if (publish_time.empty()) {
       ESP_LOGW(TAG, "Empty publish_time");
       return false;
@@ -112,7 +111,18 @@ struct Record {
       doy += days_in_month(i, publish_esp_time.year);
     publish_esp_time.day_of_year = doy;
     publish_esp_time.recalc_timestamp_local();
-    time_t publish_time_ts = publish_esp_time.timestamp;
+    timestamp = publish_esp_time.timestamp;
+    return true;
+  }
+
+  bool validate(esphome::ESPTime time, size_t minutes) const {
+    if (!time.is_valid()) {
+      ESP_LOGW(TAG, "Invalid time");
+      return false;
+    }
+
+    time_t publish_time_ts;
+    if (!parse_publish_time(publish_time_ts)) return false;
 
     double diff_seconds = difftime(time.timestamp, publish_time_ts);
     if (diff_seconds > (double)(minutes * 60)) {
@@ -127,9 +137,27 @@ struct Record {
     return true;
   }
 
+  /// Reset every field, keeping the strings' buffers so a reused Record does not allocate.
+  void clear() {
+    Record cleared{};
+    cleared.site_name.swap(site_name);
+    cleared.county.swap(county);
+    cleared.pollutant.swap(pollutant);
+    cleared.status.swap(status);
+    cleared.publish_time.swap(publish_time);
+    *this = std::move(cleared);
+    site_name.clear();
+    county.clear();
+    pollutant.clear();
+    status.clear();
+    publish_time.clear();
+  }
+
   bool operator==(const Record &rhs) const = default;
 };
 
+using History = RecordHistory<MOENV_AQI_HISTORY_SIZE>;
+
 class MoenvAQI : public PollingComponent {
  public:
   float get_setup_priority() const override;
@@ -169,10 +197,28 @@ class MoenvAQI : public PollingComponent {
   void set_retry_delay(V retry_delay) {
     retry_delay_ = retry_delay;
   }
+  template <typename V>
+  void set_probe_publish_time(V probe_publish_time) {
+    probe_publish_time_ = probe_publish_time;
+  }
+  template <typename V>
+  void set_endpoint(V endpoint) {
+    endpoint_ = endpoint;
+  }
+  template <typename V>
+  void set_prefetch(V prefetch) {
+    prefetch_ = prefetch;
+  }
+  /// The budget is shared by every instance on the device.
+  void set_request_budget(uint32_t max_requests, uint32_t window, uint32_t reserve) {
+    global_fetch_coordinator.set_request_budget(max_requests, window, reserve);
+  }
 
   void set_time(time::RealTimeClock *rtc) { rtc_ = rtc; }
 
   Record &get_data() { return this->data_; }
+  const History &get_history() const { return this->history_; }
+  void set_history_size(size_t hours) { this->history_.set_window(hours); }
   Trigger<Record &> *get_on_data_change_trigger() { return &this->on_data_change_trigger_; }
   Trigger<> *get_on_error_trigger() { return &this->on_error_trigger_; }
 
@@ -195,6 +241,15 @@ class MoenvAQI : public PollingComponent {
   void set_site_id_sensor(sensor::Sensor *sensor) { site_id_ = sensor; }
   void set_longitude_sensor(sensor::Sensor *sensor) { longitude_ = sensor; }
   void set_latitude_sensor(sensor::Sensor *sensor) { latitude_ = sensor; }
+  void set_aqi_min_sensor(sensor::Sensor *sensor) { aqi_min_ = sensor; }
+  void set_aqi_max_sensor(sensor::Sensor *sensor) { aqi_max_ = sensor; }
+  void set_aqi_mean_sensor(sensor::Sensor *sensor) { aqi_mean_ = sensor; }
+  void set_aqi_trend_sensor(sensor::Sensor *sensor) { aqi_trend_ = sensor; }
+  void set_pm2_5_min_sensor(sensor::Sensor *sensor) { pm2_5_min_ = sensor; }
+  void set_pm2_5_max_sensor(sensor::Sensor *sensor) { pm2_5_max_ = sensor; }
+  void set_pm2_5_mean_sensor(sensor::Sensor *sensor) { pm2_5_mean_ = sensor; }
+  void set_pm2_5_trend_sensor(sensor::Sensor *sensor) { pm2_5_trend_ = sensor; }
+  void set_request_budget_remaining_sensor(sensor::Sensor *sensor) { request_budget_remaining_ = sensor; }
   void set_site_name_text_sensor(text_sensor::TextSensor *sensor) { current_site_name_ = sensor; }
   void set_county_text_sensor(text_sensor::TextSensor *sensor) { county_ = sensor; }
   void set_pollutant_text_sensor(text_sensor::TextSensor *sensor) { pollutant_ = sensor; }
@@ -205,13 +260,16 @@ class MoenvAQI : public PollingComponent {
   void set_last_error_text_sensor(text_sensor::TextSensor *sensor) { last_error_ = sensor; }
 
  protected:
-  TemplatableValue<std::string> api_key_;
-  TemplatableValue<std::string> site_name_;
-  TemplatableValue<std::string> language_;
+  TemplatableString api_key_;
+  TemplatableString site_name_;
+  TemplatableString language_;
   TemplatableValue<std::uint32_t> limit_;
   TemplatableValue<uint32_t> sensor_expiry_;
   TemplatableValue<uint32_t> retry_count_;
   TemplatableValue<uint32_t> retry_delay_;
+  TemplatableValue<bool> probe_publish_time_;
+  TemplatableValue<bool> prefetch_;
+  TemplatableString endpoint_;
   time::RealTimeClock *rtc_{nullptr};
   http_request::HttpRequestComponent *http_request_{nullptr};
 
@@ -234,6 +292,15 @@ class MoenvAQI : public PollingComponent {
   sensor::Sensor *site_id_{nullptr};
   sensor::Sensor *longitude_{nullptr};
   sensor::Sensor *latitude_{nullptr};
+  sensor::Sensor *aqi_min_{nullptr};
+  sensor::Sensor *aqi_max_{nullptr};
+  sensor::Sensor *aqi_mean_{nullptr};
+  sensor::Sensor *aqi_trend_{nullptr};
+  sensor::Sensor *pm2_5_min_{nullptr};
+  sensor::Sensor *pm2_5_max_{nullptr};
+  sensor::Sensor *pm2_5_mean_{nullptr};
+  sensor::Sensor *pm2_5_trend_{nullptr};
+  sensor::Sensor *request_budget_remaining_{nullptr};
   text_sensor::TextSensor *current_site_name_{nullptr};
   text_sensor::TextSensor *county_{nullptr};
   text_sensor::TextSensor *pollutant_{nullptr};
@@ -247,19 +314,64 @@ class MoenvAQI : public PollingComponent {
   Trigger<> on_error_trigger_{};
 
   ESPPreferenceObject pref_;
+  ESPPreferenceObject history_pref_;
   size_t last_successful_offset_ = 0;
   std::string last_site_name_;
   uint32_t last_limit_{0};
   Record data_;
+  Record scratch_;  // mapped before it is compared with data_, reused so mapping does not allocate
+  History history_;
   bool retry_in_progress_{false};
 
+  // Raw-record fingerprint of data_, used to skip re-mapping and re-publishing unchanged records
+  uint32_t record_fingerprint_{0};
+  bool record_unchanged_{false};
+  bool published_valid_{false};
+  uint32_t fingerprint_checks_{0};
+  uint32_t fingerprint_skips_{0};
+  uint32_t map_us_{0};
+  uint32_t record_cost_us_{0};
+  uint64_t saved_us_{0};
+
+  // Dataset-version probe: every record in a snapshot shares the same publishtime
+  uint32_t probe_hits_{0};
+  uint32_t last_fetch_bytes_{0};
+  uint32_t last_fetch_ms_{0};
+  uint64_t probe_bytes_saved_{0};
+  uint64_t probe_ms_saved_{0};
+  uint32_t not_modified_hits_{0};
+
+  uint32_t attempt_{0};
+  uint32_t last_update_ms_{0};
+  bool served_early_{false};  // refreshed by another instance's scan ahead of its own update
+  ScanCheckpoint checkpoint_;
+  uint32_t pages_refetched_total_{0};
+
+  // The host tests read the counters and set up offsets and checkpoints
+  friend class testing::Probe;
+
+  // Hooks used by FetchCoordinator while scanning on behalf of this instance
+  friend class FetchCoordinator;
+  bool prepare_fetch_();
+  bool join_early_();
+  bool snapshot_matches_(const char *publish_time);
+  bool probe_matches_(const char *publish_time);
+  void handle_probe_hit_(const ScanProgress &progress);
+  void handle_not_modified_(const ScanProgress &progress);
+  bool handle_record_(JsonDocument &doc, uint32_t fingerprint, const ScanProgress &progress);
+  void finish_fetch_(bool success);
+  void skip_fetch_();
+  bool needs_priority_() const { return this->data_.publish_time.empty(); }
+  void publish_request_budget_();
+  uint32_t worst_case_backoff_();
+
   bool validate_config_();
-  bool send_request_();
   void try_send_request_(uint32_t attempt);
   void reset_site_data_();
-  bool process_response_(HttpStreamAdapter &stream, Record &record, int &records_count);
+  bool map_record_(JsonDocument &doc, Record &record);
   bool check_changes_(const Record &new_data);
   bool validate_record_();
+  void record_history_();
   void publish_states_();
 };
 
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "esphome/core/defines.h"
+
+#ifndef MOENV_AQI_HISTORY_SIZE
+#define MOENV_AQI_HISTORY_SIZE 24
+#endif
+
+namespace esphome {
+namespace moenv_aqi {
+
+/// One quantized hourly sample, small enough to keep a day of history per site.
+struct HistorySample {
+  uint32_t hour;  // publish time in hours since the epoch
+  uint16_t aqi;
+  uint16_t pm2_5;
+};
+
+/// Rolling statistics over the samples currently held in the history window.
+struct HistoryStats {
+  size_t count{0};
+  float min{NAN};
+  float max{NAN};
+  float mean{NAN};
+  float slope{NAN};  // least-squares trend, units per hour
+};
+
+/// Sliding-window min/max/mean/slope for a single metric.
+/// Sums are kept as exact integers and min/max use monotonic deques, so adding
+/// or evicting a sample is O(1) (amortized for min/max) and never rescans the window.
+template <size_t N>
+class RollingSeries {
+ public:
+  void clear() {
+    n_ = sx_ = sy_ = sxx_ = sxy_ = 0;
+    min_.clear();
+    max_.clear();
+  }
+
+  void push(int32_t x, int32_t y) {
+    n_++;
+    sx_ += x;
+    sy_ += y;
+    sxx_ += static_cast<int64_t>(x) * x;
+    sxy_ += static_cast<int64_t>(x) * y;
+    while (!min_.empty() && min_.back().y >= y) min_.pop_back();
+    min_.push_back({x, y});
+    while (!max_.empty() && max_.back().y <= y) max_.pop_back();
+    max_.push_back({x, y});
+  }
+
+  /// Remove the oldest sample; it must be the one pushed first.
+  void evict(int32_t x, int32_t y) {
+    n_--;
+    sx_ -= x;
+    sy_ -= y;
+    sxx_ -= static_cast<int64_t>(x) * x;
+    sxy_ -= static_cast<int64_t>(x) * y;
+    if (!min_.empty() && min_.front().x == x) min_.pop_front();
+    if (!max_.empty() && max_.front().x == x) max_.pop_front();
+  }
+
+  HistoryStats stats() const {
+    HistoryStats stats;
+    stats.count = static_cast<size_t>(n_);
+    if (n_ == 0) return stats;
+    stats.min = min_.front().y;
+    stats.max = max_.front().y;
+    stats.mean = static_cast<float>(static_cast<double>(sy_) / n_);
+    const int64_t denom = n_ * sxx_ - sx_ * sx_;
+    if (denom != 0) {
+      stats.slope = static_cast<float>(static_cast<double>(n_ * sxy_ - sx_ * sy_) / denom);
+    }
+    return stats;
+  }
+
+ protected:
+  struct Entry {
+    int32_t x;
+    int32_t y;
+  };
+
+  /// Fixed-capacity ring deque; never holds more entries than the window.
+  struct Deque {
+    Entry items[N];
+    size_t head{0};
+    size_t size{0};
+
+    bool empty() const { return size == 0; }
+    void clear() { head = size = 0; }
+    const Entry &front() const { return items[head]; }
+    const Entry &back() const { return items[(head + size - 1) % N]; }
+    void push_back(const Entry &e) { items[(head + size++) % N] = e; }
+    void pop_back() { size--; }
+    void pop_front() {
+      head = (head + 1) % N;
+      size--;
+    }
+  };
+
+  int64_t n_{0};
+  int64_t sx_{0};
+  int64_t sy_{0};
+  int64_t sxx_{0};
+  int64_t sxy_{0};
+  Deque min_{};
+  Deque max_{};
+};
+
+/// Fixed-size ring of hourly samples covering the last window hours of published records,
+/// where the window is at most N. The raw ring is a plain struct so it can be persisted
+/// with ESPPreferenceObject; derived statistics are rebuilt once on restore and then
+/// maintained incrementally.
+template <size_t N>
+class RecordHistory {
+ public:
+  static constexpr size_t CAPACITY = N;
+
+  struct Store {
+    uint32_t head;
+    uint32_t count;
+    HistorySample samples[N];
+  };
+
+  /// Limit the window to fewer hours than the compiled capacity. Call before restore().
+  void set_window(size_t hours) { window_ = hours < 1 ? 1 : (hours > N ? N : hours); }
+  size_t get_window() const { return window_; }
+
+  void clear() {
+    store_.head = 0;
+    store_.count = 0;
+    base_hour_ = 0;
+    aqi_.clear();
+    pm2_5_.clear();
+  }
+
+  /// Append a sample. Returns false if it is not newer than the latest sample.
+  bool add(const HistorySample &sample) {
+    if (store_.count > 0 && sample.hour <= latest().hour) return false;
+
+    // Keep the window to the last window_ hours, even when hourly records were missed
+    while (store_.count > 0 && (store_.count >= window_ || oldest_().hour + window_ <= sample.hour)) {
+      evict_oldest_();
+    }
+    if (store_.count == 0) base_hour_ = sample.hour;
+
+    store_.samples[(store_.head + store_.count) % N] = sample;
+    store_.count++;
+    const int32_t x = static_cast<int32_t>(sample.hour - base_hour_);
+    aqi_.push(x, sample.aqi);
+    pm2_5_.push(x, sample.pm2_5);
+    return true;
+  }
+
+  /// Rebuild the ring and its statistics from persisted storage.
+  void restore(const Store &store) {
+    clear();
+    if (store.head >= N || store.count > N) return;
+    for (uint32_t i = 0; i < store.count; i++) {
+      add(store.samples[(store.head + i) % N]);
+    }
+  }
+
+  const Store &get_store() const { return store_; }
+  size_t size() const { return store_.count; }
+  bool empty() const { return store_.count == 0; }
+  const HistorySample &latest() const { return store_.samples[(store_.head + store_.count - 1) % N]; }
+  /// Sample at position i, where 0 is the oldest.
+  const HistorySample &at(size_t i) const { return store_.samples[(store_.head + i) % N]; }
+
+  HistoryStats aqi_stats() const { return aqi_.stats(); }
+  HistoryStats pm2_5_stats() const { return pm2_5_.stats(); }
+
+ protected:
+  const HistorySample &oldest_() const { return store_.samples[store_.head]; }
+
+  void evict_oldest_() {
+    const HistorySample &s = oldest_();
+    const int32_t x = static_cast<int32_t>(s.hour - base_hour_);
+    aqi_.evict(x, s.aqi);
+    pm2_5_.evict(x, s.pm2_5);
+    store_.head = (store_.head + 1) % N;
+    store_.count--;
+  }
+
+  Store store_{};
+  size_t window_{N};
+  uint32_t base_hour_{0};
+  RollingSeries<N> aqi_{};
+  RollingSeries<N> pm2_5_{};
+};
+
+}  // namespace moenv_aqi
+}  // namespace esphome
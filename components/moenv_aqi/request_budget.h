@@ -0,0 +1,110 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+
+#include "esphome/core/helpers.h"
+#include "esphome/core/preferences.h"
+
+namespace esphome {
+namespace moenv_aqi {
+
+/// Counts API requests over a rolling window, so devices sharing a rate-limited key
+/// stay under the limit. The window is split into buckets keyed by wall-clock time,
+/// which lets the count be persisted and carried across reboots.
+class RequestBudget {
+ public:
+  static constexpr size_t BUCKETS = 12;
+
+  struct Store {
+    uint32_t window;  // seconds; a stored count is discarded if the window changes
+    uint32_t bucket;  // newest bucket, in bucket lengths since the epoch
+    uint16_t counts[BUCKETS];
+  };
+
+  void configure(uint32_t max_requests, uint32_t window, uint32_t reserve) {
+    max_requests_ = max_requests;
+    window_ = std::max<uint32_t>(window, BUCKETS);
+    reserve_ = reserve;
+  }
+
+  bool enabled() const { return max_requests_ > 0; }
+
+  /// Move the window forward to the current time, dropping buckets that fell out of it.
+  void advance(time_t now) {
+    if (!this->enabled() || now <= 0) return;
+    if (!loaded_) this->load_();
+
+    const uint32_t bucket = static_cast<uint32_t>(now) / (window_ / BUCKETS);
+    if (store_.bucket == 0 || bucket < store_.bucket) {
+      store_.bucket = bucket;  // first use, or the clock moved back
+      return;
+    }
+    const uint32_t steps = std::min<uint32_t>(bucket - store_.bucket, BUCKETS);
+    for (uint32_t i = 1; i <= steps; i++) store_.counts[(store_.bucket + i) % BUCKETS] = 0;
+    store_.bucket = bucket;
+  }
+
+  /// Count one request against the current bucket.
+  void record() {
+    if (!this->enabled()) return;
+    uint16_t &count = store_.counts[store_.bucket % BUCKETS];
+    if (count < UINT16_MAX) count++;
+  }
+
+  void save() {
+    if (this->enabled() && loaded_) pref_.save(&store_);
+  }
+
+  uint32_t used() const {
+    uint32_t used = 0;
+    for (uint16_t count : store_.counts) used += count;
+    return used;
+  }
+
+  uint32_t remaining() const {
+    if (!this->enabled()) return UINT32_MAX;
+    const uint32_t used = this->used();
+    return used < max_requests_ ? max_requests_ - used : 0;
+  }
+
+  /// Requests a pass may make. Normal updates leave the reserve untouched; first
+  /// fetches and site changes may spend it.
+  uint32_t allowance(bool priority) const {
+    const uint32_t remaining = this->remaining();
+    if (priority || !this->enabled()) return remaining;
+    return remaining > reserve_ ? remaining - reserve_ : 0;
+  }
+
+  /// Below twice the reserve, only the cheapest strategies are used.
+  bool low() const { return this->enabled() && this->remaining() <= 2 * reserve_; }
+
+  uint32_t get_max_requests() const { return max_requests_; }
+  uint32_t get_window() const { return window_; }
+  uint32_t get_reserve() const { return reserve_; }
+
+ protected:
+  void load_() {
+    loaded_ = true;
+    pref_ = global_preferences->make_preference<Store>(fnv1_hash("moenv_aqi_request_budget"));
+    Store store{};
+    if (pref_.load(&store) && store.window == window_) {
+      store_ = store;
+    } else {
+      store_ = Store{};
+      store_.window = window_;
+    }
+  }
+
+  ESPPreferenceObject pref_;
+  Store store_{};
+  uint32_t max_requests_{0};
+  uint32_t window_{3600};
+  uint32_t reserve_{0};
+  bool loaded_{false};
+};
+
+}  // namespace moenv_aqi
+}  // namespace esphome
@@ -47,6 +47,15 @@ CONF_PM10_AVG = "pm10_avg"
 CONF_SITE_ID = "site_id"
 CONF_LONGITUDE = "longitude"
 CONF_LATITUDE = "latitude"
+CONF_AQI_MIN = "aqi_min"
+CONF_AQI_MAX = "aqi_max"
+CONF_AQI_MEAN = "aqi_mean"
+CONF_AQI_TREND = "aqi_trend"
+CONF_PM2_5_MIN = "pm2_5_min"
+CONF_PM2_5_MAX = "pm2_5_max"
+CONF_PM2_5_MEAN = "pm2_5_mean"
+CONF_PM2_5_TREND = "pm2_5_trend"
+CONF_REQUEST_BUDGET_REMAINING = "request_budget_remaining"
 
 CONFIG_SCHEMA = (
     cv.Schema(
@@ -174,6 +183,66 @@ CONFIG_SCHEMA = (
                 accuracy_decimals=6,
                 entity_category="diagnostic",
             ),
+            cv.Optional(CONF_AQI_MIN): sensor.sensor_schema(
+                unit_of_measurement=UNIT_EMPTY,
+                icon=ICON_GAUGE,
+                device_class=DEVICE_CLASS_AQI,
+                state_class=STATE_CLASS_MEASUREMENT,
+                accuracy_decimals=0,
+            ),
+            cv.Optional(CONF_AQI_MAX): sensor.sensor_schema(
+                unit_of_measurement=UNIT_EMPTY,
+                icon=ICON_GAUGE,
+                device_class=DEVICE_CLASS_AQI,
+                state_class=STATE_CLASS_MEASUREMENT,
+                accuracy_decimals=0,
+            ),
+            cv.Optional(CONF_AQI_MEAN): sensor.sensor_schema(
+                unit_of_measurement=UNIT_EMPTY,
+                icon=ICON_GAUGE,
+                device_class=DEVICE_CLASS_AQI,
+                state_class=STATE_CLASS_MEASUREMENT,
+                accuracy_decimals=1,
+            ),
+            cv.Optional(CONF_AQI_TREND): sensor.sensor_schema(
+                unit_of_measurement="/h",
+                icon="mdi:trending-up",
+                state_class=STATE_CLASS_MEASUREMENT,
+                accuracy_decimals=2,
+            ),
+            cv.Optional(CONF_PM2_5_MIN): sensor.sensor_schema(
+                unit_of_measurement=UNIT_MICROGRAMS_PER_CUBIC_METER,
+                icon=ICON_GRAIN,
+                device_class=DEVICE_CLASS_PM25,
+                state_class=STATE_CLASS_MEASUREMENT,
+                accuracy_decimals=0,
+            ),
+            cv.Optional(CONF_PM2_5_MAX): sensor.sensor_schema(
+                unit_of_measurement=UNIT_MICROGRAMS_PER_CUBIC_METER,
+                icon=ICON_GRAIN,
+                device_class=DEVICE_CLASS_PM25,
+                state_class=STATE_CLASS_MEASUREMENT,
+                accuracy_decimals=0,
+            ),
+            cv.Optional(CONF_PM2_5_MEAN): sensor.sensor_schema(
+                unit_of_measurement=UNIT_MICROGRAMS_PER_CUBIC_METER,
+                icon=ICON_GRAIN,
+                device_class=DEVICE_CLASS_PM25,
+                state_class=STATE_CLASS_MEASUREMENT,
+                accuracy_decimals=1,
+            ),
+            cv.Optional(CONF_PM2_5_TREND): sensor.sensor_schema(
+                unit_of_measurement="µg/m³/h",
+                icon="mdi:trending-up",
+                state_class=STATE_CLASS_MEASUREMENT,
+                accuracy_decimals=2,
+            ),
+            cv.Optional(CONF_REQUEST_BUDGET_REMAINING): sensor.sensor_schema(
+                icon="mdi:counter",
+                state_class=STATE_CLASS_MEASUREMENT,
+                accuracy_decimals=0,
+                entity_category="diagnostic",
+            ),
         }
     )
     .extend(CHILD_SCHEMA)
@@ -200,6 +269,15 @@ SENSORS = [
     CONF_SITE_ID,
     CONF_LONGITUDE,
     CONF_LATITUDE,
+    CONF_AQI_MIN,
+    CONF_AQI_MAX,
+    CONF_AQI_MEAN,
+    CONF_AQI_TREND,
+    CONF_PM2_5_MIN,
+    CONF_PM2_5_MAX,
+    CONF_PM2_5_MEAN,
+    CONF_PM2_5_TREND,
+    CONF_REQUEST_BUDGET_REMAINING,
 ]
 
 
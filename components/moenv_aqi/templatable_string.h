@@ -0,0 +1,39 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace esphome {
+namespace moenv_aqi {
+
+/// A templatable string option read by reference. TemplatableValue<std::string> returns a
+/// copy from every value() call, which allocates once the string outgrows the small-string
+/// buffer, as endpoints and API keys do. A constant is stored once; a lambda is evaluated
+/// on every read, into the same buffer.
+class TemplatableString {
+ public:
+  template<typename V> TemplatableString &operator=(V value) {
+    if constexpr (std::is_invocable_v<V>) {
+      f_ = std::move(value);
+    } else {
+      value_ = std::move(value);
+      f_ = nullptr;
+    }
+    return *this;
+  }
+
+  /// Valid until the next call.
+  const std::string &value() const {
+    if (f_) value_ = f_();
+    return value_;
+  }
+
+ protected:
+  mutable std::string value_;
+  std::function<std::string()> f_;
+};
+
+}  // namespace moenv_aqi
+}  // namespace esphome
@@ -0,0 +1,60 @@
+#include "trace.h"
+
+#ifdef MOENV_AQI_TRACE
+
+#include <cstring>
+
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace moenv_aqi {
+
+static const char *const TAG = "moenv_aqi.trace";
+
+Tracer global_tracer;  // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+void Tracer::log_summary() const {
+  struct Summary {
+    const char *name;
+    uint32_t count;
+    uint32_t total_us;
+    uint32_t max_us;
+  };
+  Summary summaries[MAX_NAMES]{};
+  size_t names = 0;
+
+  for (size_t i = 0; i < count_; i++) {
+    const TraceSpan &span = spans_[(head_ + i) % CAPACITY];
+    size_t n = 0;
+    while (n < names && strcmp(summaries[n].name, span.name) != 0) n++;
+    if (n == names) {
+      if (names == MAX_NAMES) continue;
+      summaries[names++].name = span.name;
+    }
+    Summary &summary = summaries[n];
+    summary.count++;
+    summary.total_us += span.duration_us;
+    if (span.duration_us > summary.max_us) summary.max_us = span.duration_us;
+  }
+
+  ESP_LOGD(TAG, "Trace summary: %u span(s), %u dropped", count_, dropped_);
+  for (size_t n = 0; n < names; n++) {
+    const Summary &summary = summaries[n];
+    ESP_LOGD(TAG, "  %-14s n=%-4u total=%u us, mean=%u us, max=%u us", summary.name, summary.count,
+             summary.total_us, summary.total_us / summary.count, summary.max_us);
+  }
+}
+
+void Tracer::log_chrome_trace() const {
+  // Wrap the collected lines in [ ] to load them in chrome://tracing or Perfetto
+  for (size_t i = 0; i < count_; i++) {
+    const TraceSpan &span = spans_[(head_ + i) % CAPACITY];
+    ESP_LOGV(TAG, "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%u,\"dur\":%u,\"pid\":1,\"tid\":1},", span.name,
+             span.start_us, span.duration_us);
+  }
+}
+
+}  // namespace moenv_aqi
+}  // namespace esphome
+
+#endif  // MOENV_AQI_TRACE
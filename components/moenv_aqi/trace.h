@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "esphome/core/defines.h"
+#include "esphome/core/hal.h"
+
+#ifndef MOENV_AQI_TRACE_SIZE
+#define MOENV_AQI_TRACE_SIZE 256
+#endif
+
+namespace esphome {
+namespace moenv_aqi {
+
+#ifdef MOENV_AQI_TRACE
+
+/// One completed span. The name must be a string literal; only the pointer is kept.
+struct TraceSpan {
+  const char *name;
+  uint32_t start_us;
+  uint32_t duration_us;
+};
+
+/// Preallocated ring of spans recorded during a fetch pass. When the ring is full
+/// the oldest spans are overwritten, so recording never allocates.
+class Tracer {
+ public:
+  static constexpr size_t CAPACITY = MOENV_AQI_TRACE_SIZE;
+  static constexpr size_t MAX_NAMES = 16;
+
+  void clear() {
+    head_ = 0;
+    count_ = 0;
+    dropped_ = 0;
+  }
+
+  void record(const char *name, uint32_t start_us, uint32_t duration_us) {
+    if (count_ == CAPACITY) {
+      head_ = (head_ + 1) % CAPACITY;
+      count_--;
+      dropped_++;
+    }
+    spans_[(head_ + count_) % CAPACITY] = TraceSpan{name, start_us, duration_us};
+    count_++;
+  }
+
+  /// Spans currently held, oldest first.
+  size_t size() const { return count_; }
+  const TraceSpan &operator[](size_t index) const { return spans_[(head_ + index) % CAPACITY]; }
+  uint32_t get_dropped() const { return dropped_; }
+
+  /// Log count, total and longest duration per span name.
+  void log_summary() const;
+
+  /// Log every span as a Chrome trace event, one per line, at verbose level.
+  void log_chrome_trace() const;
+
+ protected:
+  TraceSpan spans_[CAPACITY]{};
+  size_t head_{0};
+  size_t count_{0};
+  uint32_t dropped_{0};
+};
+
+extern Tracer global_tracer;  // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+/// Records the lifetime of the enclosing scope as a span.
+class TraceScope {
+ public:
+  explicit TraceScope(const char *name) : name_(name), start_us_(micros()) {}
+  ~TraceScope() { global_tracer.record(name_, start_us_, micros() - start_us_); }
+
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+
+ protected:
+  const char *name_;
+  uint32_t start_us_;
+};
+
+#define MOENV_TRACE_CONCAT_(a, b) a##b
+#define MOENV_TRACE_CONCAT(a, b) MOENV_TRACE_CONCAT_(a, b)
+#define MOENV_TRACE_SCOPE(name) ::esphome::moenv_aqi::TraceScope MOENV_TRACE_CONCAT(moenv_trace_, __LINE__)(name)
+
+#else
+
+#define MOENV_TRACE_SCOPE(name) ((void) 0)
+
+#endif  // MOENV_AQI_TRACE
+
+}  // namespace moenv_aqi
+}  // namespace esphome
@@ -0,0 +1,108 @@
+// Steady-state updates must not allocate. Each path runs once to size the buffers that are
+// reused across passes, then again while malloc and operator new are counted: a probe
+// hit, a 304, a multi-page scan whose record is skipped by its fingerprint, and a changed
+// record mapped and published to numeric sensors. Text sensors are left out, since
+// publishing a string state copies it.
+
+#include "fixture.h"
+
+using namespace esphome;
+using namespace esphome::moenv_aqi;
+using namespace esphome::moenv_aqi::testing;
+
+static Device device;  // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+// Long enough that copying either one would allocate
+static const char *const API_KEY = "0f6b7d3e-1c2a-4b5e-9f8d-7a6c5b4e3d2c";
+static const char *const ENDPOINT = "https://data.moenv.gov.tw/api/v2/aqx_p_432?format=json";
+
+static MoenvAQI *add(const char *site, bool probe) {
+  MoenvAQI *instance = device.add(site);
+  instance->set_api_key(std::string(API_KEY));
+  instance->set_endpoint(std::string(ENDPOINT));
+  instance->set_probe_publish_time(probe);
+  return instance;
+}
+
+static uint64_t allocations_for_update(MoenvAQI *instance) {
+  const uint64_t before = allocation_count();
+  instance->update();
+  run_scheduler();
+  return allocation_count() - before;
+}
+
+static void new_snapshot(int hour) {
+  device.set_time(hour, 20);
+  char publish_time[32];
+  snprintf(publish_time, sizeof(publish_time), "2026/10/18 %02d:00:00", hour);
+  UntrackedHeapScope untracked;
+  device.server.publish_time = publish_time;
+}
+
+int main() {
+  ReplayServer &server = device.server;
+  sensor::Sensor aqi;
+  sensor::Sensor pm2_5;
+
+  // Probe hit: the first record of the first page shows the snapshot is unchanged
+  MoenvAQI *a = add("S50", true);
+  a->set_aqi_sensor(&aqi);
+  a->set_pm2_5_sensor(&pm2_5);
+  allocations_for_update(a);
+  allocations_for_update(a);
+  CHECK(Probe::probe_hits(a) == 1);
+  server.requests.clear();
+  uint64_t count = allocations_for_update(a);
+  printf("probe hit: %llu allocations\n", static_cast<unsigned long long>(count));
+  CHECK(Probe::probe_hits(a) == 2 && server.requests.size() == 1);
+  CHECK(count == 0);
+
+  // Fingerprint skip: without the probe, and starting from the first page instead of the
+  // site's last offset, every page up to the site is read and parsed
+  MoenvAQI *b = add("S77", false);
+  allocations_for_update(b);
+  Probe::last_successful_offset(b) = 0;
+  allocations_for_update(b);
+  const uint32_t skips = Probe::fingerprint_skips(b);
+  server.requests.clear();
+  Probe::last_successful_offset(b) = 0;
+  count = allocations_for_update(b);
+  printf("fingerprint skip over %zu pages: %llu allocations\n", server.requests.size(),
+         static_cast<unsigned long long>(count));
+  CHECK(server.requests.size() == 4 && Probe::fingerprint_skips(b) == skips + 1);
+  CHECK(count == 0);
+
+  // Changed record: a new snapshot is mapped into the reused scratch record, copied into
+  // data_ and published
+  new_snapshot(11);
+  allocations_for_update(a);
+  new_snapshot(12);
+  const int publishes = aqi.publishes;
+  count = allocations_for_update(a);
+  printf("changed record: %llu allocations\n", static_cast<unsigned long long>(count));
+  CHECK(a->get_data().publish_time == "2026/10/18 12:00:00" && aqi.publishes == publishes + 1);
+  CHECK(count == 0);
+
+  // 304: validators from the full read make the request conditional, with headers
+  // reused from the last conditional request
+  {
+    UntrackedHeapScope untracked;
+    server.etag = "\"v12\"";
+  }
+  allocations_for_update(a);
+  allocations_for_update(a);
+  const uint32_t not_modified = Probe::not_modified_hits(a);
+  server.requests.clear();
+  count = allocations_for_update(a);
+  printf("304: %llu allocations\n", static_cast<unsigned long long>(count));
+  CHECK(server.requests.size() == 1 && server.requests[0].status == 304);
+  CHECK(Probe::not_modified_hits(a) == not_modified + 1);
+  CHECK(count == 0);
+
+  // Records were parsed in the arena, never on the heap
+  const JsonArena &arena = Probe::arena(global_fetch_coordinator);
+  printf("JSON arena peak %zu of %zu bytes, %u overflows\n", arena.get_peak(), JsonArena::SIZE,
+         arena.get_overflows());
+  CHECK(arena.get_peak() > 0 && arena.get_overflows() == 0);
+  return 0;
+}
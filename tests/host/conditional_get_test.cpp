@@ -0,0 +1,119 @@
+// Conditional requests against the replay server: a 304 after a 200, a changed ETag,
+// and a 304 for a snapshot that only some instances in the pass hold
+
+#include "fixture.h"
+
+using namespace esphome;
+using namespace esphome::moenv_aqi;
+using namespace esphome::moenv_aqi::testing;
+
+static Device device;  // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+static const http_request::Header *find_header(const std::list<http_request::Header> &headers, const char *name) {
+  for (const auto &header : headers) {
+    if (header.name == name) return &header;
+  }
+  return nullptr;
+}
+
+static std::list<http_request::Header> last_headers;  // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+static void new_snapshot(int hour, const char *etag) {
+  device.set_time(hour, 20);
+  char publish_time[32];
+  snprintf(publish_time, sizeof(publish_time), "2026/10/18 %02d:00:00", hour);
+  device.server.publish_time = publish_time;
+  device.server.etag = etag;
+}
+
+int main() {
+  ReplayServer &server = device.server;
+  device.http.set_handler([](const std::string &url, const std::list<http_request::Header> &headers,
+                             const std::set<std::string> &collect_headers) {
+    {
+      UntrackedHeapScope untracked;
+      last_headers = headers;
+    }
+    return device.server.handle(url, headers, collect_headers);
+  });
+
+  MoenvAQI *b = device.add("S3");
+  MoenvAQI *c = device.add("S5");
+  new_snapshot(10, "\"v1\"");
+  b->update();
+  c->update();
+  run_scheduler();
+  CHECK(server.requests.size() == 1 && !server.requests[0].conditional);
+
+  // 200 then 304: the validators from the full read make the next request conditional,
+  // and the 304 keeps the data without a body
+  sensor::Sensor aqi;
+  b->set_aqi_sensor(&aqi);
+  server.requests.clear();
+  const size_t bytes = server.bytes_sent;
+  b->update();
+  run_scheduler();
+  CHECK(server.requests.size() == 1 && server.requests[0].conditional && server.requests[0].status == 304);
+  CHECK(find_header(last_headers, "If-None-Match") != nullptr);
+  CHECK(find_header(last_headers, "If-None-Match")->value == "\"v1\"");
+  CHECK(server.bytes_sent == bytes);
+  CHECK(Probe::not_modified_hits(b) == 1 && b->get_data().publish_time == "2026/10/18 10:00:00");
+  CHECK(!b->is_warning() && b->get_on_error_trigger()->count == 0);
+
+  // Changed ETag: the server sends the new snapshot in full, and its ETag is used next
+  new_snapshot(11, "\"v2\"");
+  server.requests.clear();
+  b->update();
+  run_scheduler();
+  CHECK(server.requests.size() == 1 && server.requests[0].conditional && server.requests[0].status == 200);
+  CHECK(b->get_data().publish_time == "2026/10/18 11:00:00" && Probe::not_modified_hits(b) == 1);
+  server.requests.clear();
+  b->update();
+  run_scheduler();
+  CHECK(server.requests.size() == 1 && server.requests[0].status == 304);
+  CHECK(find_header(last_headers, "If-None-Match")->value == "\"v2\"");
+  CHECK(Probe::not_modified_hits(b) == 2);
+
+  // Foreign snapshot: c still holds 10:00, so the 304 (which confirms 11:00) does not
+  // apply to it. The page is fetched again without validators, and that one request is
+  // the only page fetch charged to c.
+  server.requests.clear();
+  c->update();
+  run_scheduler();
+  CHECK(server.requests.size() == 2);
+  CHECK(server.requests[0].conditional && server.requests[0].status == 304);
+  CHECK(!server.requests[1].conditional && server.requests[1].status == 200 && last_headers.empty());
+  CHECK(c->get_data().publish_time == "2026/10/18 11:00:00" && Probe::not_modified_hits(c) == 0);
+  CHECK(Probe::pages_refetched_total(c) == 0);
+
+  // b and c in one pass: the 304 settles b, c reads the body from the unconditional request
+  new_snapshot(12, "\"v3\"");
+  b->update();
+  run_scheduler();
+  server.requests.clear();
+  b->update();
+  c->update();
+  run_scheduler();
+  CHECK(server.requests.size() == 2 && server.requests[0].status == 304 && server.requests[1].status == 200);
+  CHECK(Probe::not_modified_hits(b) == 3 && c->get_data().publish_time == "2026/10/18 12:00:00");
+
+  // A page whose snapshot cannot be read (a numeric publishtime on its first record) has
+  // no validators kept, so the next request for it is not conditional
+  new_snapshot(13, "\"v4\"");
+  server.tamper = [](size_t, const ReplayServer::Request &request, ReplayResponse &response) {
+    const size_t pos = response.body.find("\"publishtime\":\"");
+    if (request.offset == 0 && pos != std::string::npos) response.body.replace(pos + 14, 21, "2026");
+  };
+  server.requests.clear();
+  b->update();
+  run_scheduler();
+  CHECK(server.requests.size() == 1 && server.requests[0].status == 200);
+  CHECK(b->get_data().publish_time == "2026/10/18 13:00:00");
+  b->update();
+  run_scheduler();
+  CHECK(server.requests.size() == 2 && !server.requests[1].conditional && server.requests[1].status == 200);
+  server.tamper = nullptr;
+
+  puts("conditional_get_test: OK");
+  return 0;
+}
@@ -0,0 +1,195 @@
+// Shared scans, probes, checkpoints, prefetch and the request budget, run against the
+// replay server one update cycle at a time
+
+#include "fixture.h"
+
+using namespace esphome;
+using namespace esphome::moenv_aqi;
+using namespace esphome::moenv_aqi::testing;
+
+static Device device;  // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+// Fail the read of the page at this offset, once, halfway through its body
+static void fail_page_once(size_t offset) {
+  device.server.tamper = [offset](size_t, const ReplayServer::Request &request, ReplayResponse &response) {
+    if (request.offset != offset || response.status != 200) return;
+    response.fail_at = response.body.size() / 2;
+    device.server.tamper = nullptr;
+  };
+}
+
+int main() {
+  ReplayServer &server = device.server;
+  FetchCoordinator &coordinator = global_fetch_coordinator;
+
+  MoenvAQI *a = device.add("S50");
+  MoenvAQI *b = device.add("S3");
+  MoenvAQI *c = device.add("S77");
+  sensor::Sensor aqi_a;
+  a->set_aqi_sensor(&aqi_a);
+
+  // One shared first scan serves all three sites; S77 is on the fourth page
+  a->update();
+  b->update();
+  c->update();
+  run_scheduler();
+  CHECK(server.requests.size() == 4);
+  CHECK(a->get_data().site_name == "S50" && b->get_data().site_name == "S3" && c->get_data().site_name == "S77");
+  CHECK(Probe::last_successful_offset(a) == 40 && Probe::last_successful_offset(b) == 0 &&
+        Probe::last_successful_offset(c) == 60);
+  CHECK(a->get_on_data_change_trigger()->count == 1);
+
+  // Same snapshot: the probe settles every instance from the first page
+  server.requests.clear();
+  const int publishes = aqi_a.publishes;
+  a->update();
+  b->update();
+  c->update();
+  run_scheduler();
+  CHECK(server.requests.size() == 1);
+  CHECK(Probe::probe_hits(a) == 1 && Probe::probe_hits(b) == 1 && Probe::probe_hits(c) == 1);
+  CHECK(aqi_a.publishes == publishes);
+
+  // New snapshot with a read error on the fourth page: the retry resumes from that page
+  server.publish_time = "2026/10/18 11:00:00";
+  device.set_time(11, 20);
+  server.requests.clear();
+  fail_page_once(60);
+  a->update();
+  b->update();
+  c->update();
+  run_scheduler();
+  CHECK(c->get_data().publish_time == "2026/10/18 11:00:00");
+  CHECK(a->get_on_data_change_trigger()->count == 2);
+  CHECK(server.requests.size() == 5 && server.requests.back().offset == 60);
+  CHECK(Probe::pages_refetched_total(c) == 1);
+
+  // Unknown site: each attempt scans everything again, since the end of the data one scan
+  // saw may have been a page cut short; on_error after the last one
+  MoenvAQI *unknown = device.add("NOPE");
+  server.requests.clear();
+  unknown->update();
+  run_scheduler();
+  CHECK(unknown->get_on_error_trigger()->count == 1);
+  CHECK(server.requests.size() == 4 * 5);
+
+  // A complete first page that ends after 10 of its 20 records looks like the end of the
+  // data, so S55 is not found; the retry reads the pages again and finds it
+  MoenvAQI *shortened = device.add("S55");
+  server.tamper = [&server](size_t, const ReplayServer::Request &request, ReplayResponse &response) {
+    if (request.offset != 0) return;
+    response.body = server.page(0, 10);
+    server.tamper = nullptr;
+  };
+  server.requests.clear();
+  shortened->update();
+  run_scheduler();
+  CHECK(server.requests.size() == 4 && server.requests[1].offset == 0 && server.requests[3].offset == 40);
+  CHECK(shortened->get_data().site_name == "S55" && shortened->get_on_error_trigger()->count == 0);
+
+  // Prefetch: pages after the first are requested ahead; the one past the end is cancelled
+  MoenvAQI *prefetching = device.add("S90");
+  prefetching->set_prefetch(true);
+  server.requests.clear();
+  prefetching->update();
+  run_scheduler();
+  CHECK(prefetching->get_data().site_name == "S90");
+  CHECK(Probe::prefetch_used(coordinator) == 3 && Probe::prefetch_cancelled(coordinator) == 1);
+
+  // Request budget: normal updates stop at the reserve, without errors
+  MoenvAQI *budgeted = device.add("S30");
+  budgeted->set_request_budget(6, 3600, 2);
+  sensor::Sensor remaining;
+  budgeted->set_request_budget_remaining_sensor(&remaining);
+  server.requests.clear();
+  budgeted->update();
+  run_scheduler();
+  CHECK(server.requests.size() == 2 && remaining.state == 4);
+  budgeted->update();  // probe hit on the second page
+  run_scheduler();
+  budgeted->update();
+  run_scheduler();
+  CHECK(server.requests.size() == 4 && remaining.state == 2);
+  budgeted->update();  // down to the reserve: skipped
+  run_scheduler();
+  CHECK(server.requests.size() == 4 && budgeted->get_on_error_trigger()->count == 0);
+  budgeted->set_request_budget(1000, 3600, 2);
+
+  // Randomized interval offsets: b is brought forward into a's scan and skips its own update
+  a->set_update_interval(600000);
+  b->set_update_interval(600000);
+  a->update();
+  b->update();
+  run_scheduler();
+  advance_time(400000);
+  server.requests.clear();
+  const uint32_t b_probe_hits = Probe::probe_hits(b);
+  a->update();
+  run_scheduler();
+  CHECK(Probe::served_early(b) && Probe::probe_hits(b) == b_probe_hits + 1 && server.requests.size() == 1);
+  advance_time(200000);
+  b->update();
+  run_scheduler();
+  CHECK(server.requests.size() == 1 && !Probe::served_early(b));
+
+  // Brought forward again, then moved to another site: the manual update fetches it
+  advance_time(400000);
+  a->update();
+  run_scheduler();
+  CHECK(Probe::served_early(b));
+  b->set_site_name(std::string("S45"));
+  server.requests.clear();
+  b->update();
+  run_scheduler();
+  CHECK(!server.requests.empty() && b->get_data().site_name == "S45" && !Probe::served_early(b));
+
+  // Brought forward, then updated by hand before its interval is up: fetched again
+  advance_time(400000);
+  a->update();
+  run_scheduler();
+  CHECK(Probe::served_early(b));
+  const uint32_t b_probe_hits_manual = Probe::probe_hits(b);
+  server.requests.clear();
+  b->update();
+  run_scheduler();
+  CHECK(server.requests.size() == 1 && Probe::probe_hits(b) == b_probe_hits_manual + 1 && !Probe::served_early(b));
+
+  // Retrying targets whose checkpoints disagree on where the data ends: the skip path
+  // must still resolve both instead of circling through cleared pages
+  MoenvAQI *gone1 = device.add("GONE1");
+  MoenvAQI *gone2 = device.add("GONE2");
+  Probe::checkpoint(gone1).reset("GONE1", 20);
+  Probe::checkpoint(gone2).reset("GONE2", 20);
+  for (size_t page = 0; page < 5; page++) Probe::checkpoint(gone1).cleared.set(page);
+  for (size_t page : {0, 1, 3, 4}) Probe::checkpoint(gone2).cleared.set(page);
+  Probe::checkpoint(gone1).active = Probe::checkpoint(gone2).active = true;
+  Probe::checkpoint(gone2).end_page = 4;
+  server.requests.clear();
+  Probe::try_send_request(gone1, 3);
+  Probe::try_send_request(gone2, 3);
+  run_scheduler();
+  CHECK(server.requests.size() == 1);
+  CHECK(gone1->get_on_error_trigger()->count == 1 && gone2->get_on_error_trigger()->count == 1);
+
+  // Request budget spent partway through a first scan: no on_error, the offset and the
+  // checkpoint are kept, and the next update resumes from the page where the scan stopped
+  MoenvAQI *far = device.add("S85");
+  const uint32_t used = coordinator.get_request_budget().used();
+  far->set_request_budget(used + 3, 3600, 1);
+  server.requests.clear();
+  far->update();
+  run_scheduler();
+  CHECK(server.requests.size() == 3 && far->get_on_error_trigger()->count == 0 && !far->is_warning());
+  CHECK(Probe::checkpoint(far).active && Probe::checkpoint(far).deferred && Probe::checkpoint(far).page == 3);
+  far->set_request_budget(used + 100, 3600, 1);
+  server.requests.clear();
+  far->update();
+  run_scheduler();
+  CHECK(server.requests.size() == 2 && server.requests[0].offset == 60);
+  CHECK(far->get_data().site_name == "S85" && Probe::last_successful_offset(far) == 80 &&
+        !Probe::checkpoint(far).deferred);
+  far->set_request_budget(1000, 3600, 2);
+
+  puts("coordinator_test: OK");
+  return 0;
+}
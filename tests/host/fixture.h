@@ -0,0 +1,110 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "host_runtime.h"
+#include "replay.h"
+
+#include "moenv_aqi/moenv_aqi.h"
+
+// Unlike assert(), also checked in release builds
+#define CHECK(condition) \
+  do { \
+    if (!(condition)) { \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+      exit(1); \
+    } \
+  } while (0)
+
+namespace esphome {
+namespace moenv_aqi {
+namespace testing {
+
+/// The tests' access to internal state: the counters they check, and the offset,
+/// checkpoint and retry attempt they set up. A friend of MoenvAQI and FetchCoordinator.
+class Probe {
+ public:
+  static uint32_t probe_hits(const MoenvAQI *instance) { return instance->probe_hits_; }
+  static uint32_t not_modified_hits(const MoenvAQI *instance) { return instance->not_modified_hits_; }
+  static uint32_t fingerprint_skips(const MoenvAQI *instance) { return instance->fingerprint_skips_; }
+  static uint32_t pages_refetched_total(const MoenvAQI *instance) { return instance->pages_refetched_total_; }
+  static bool served_early(const MoenvAQI *instance) { return instance->served_early_; }
+  static size_t &last_successful_offset(MoenvAQI *instance) { return instance->last_successful_offset_; }
+  static ScanCheckpoint &checkpoint(MoenvAQI *instance) { return instance->checkpoint_; }
+  static void try_send_request(MoenvAQI *instance, uint32_t attempt) { instance->try_send_request_(attempt); }
+
+  static uint32_t prefetch_used(const FetchCoordinator &coordinator) { return coordinator.prefetch_used_; }
+  static uint32_t prefetch_cancelled(const FetchCoordinator &coordinator) { return coordinator.prefetch_cancelled_; }
+  static uint32_t worst_stall_ms(const FetchCoordinator &coordinator) { return coordinator.worst_stall_ms_; }
+  static const JsonArena &arena(const FetchCoordinator &coordinator) { return coordinator.arena_; }
+};
+
+/// A device with a clock, an http_request component wired to a ReplayServer, and any
+/// number of moenv_aqi instances sharing them.
+class Device {
+ public:
+  Device() {
+    this->set_time(10, 20);
+    http.set_handler([this](const std::string &url, const std::list<http_request::Header> &headers,
+                            const std::set<std::string> &collect_headers) {
+      return server.handle(url, headers, collect_headers);
+    });
+  }
+
+  MoenvAQI *add(const std::string &site, uint32_t limit = 20) {
+    // The coordinator keeps a pointer to every instance, so they live as long as the device
+    auto *instance = instances_.emplace_back(std::make_unique<MoenvAQI>()).get();
+    instance->set_update_interval(SCHEDULER_DONT_RUN);  // the component's default
+    instance->set_time(&rtc);
+    instance->set_http_request(&http);
+    instance->set_api_key(std::string("key"));
+    instance->set_site_name(site);
+    instance->set_language(std::string("zh"));
+    instance->set_limit(limit);
+    instance->set_sensor_expiry(90u * 60000u);
+    instance->set_retry_count(3u);
+    instance->set_retry_delay(1000u);
+    instance->set_probe_publish_time(true);
+    instance->set_prefetch(false);
+    instance->set_endpoint(std::string("https://data.moenv.gov.tw/api/v2/aqx_p_432"));
+    instance->setup();
+    return instance;
+  }
+
+  void set_time(int hour, int minute) {
+    rtc.time.year = 2026;
+    rtc.time.month = 10;
+    rtc.time.day_of_month = 18;
+    rtc.time.hour = hour;
+    rtc.time.minute = minute;
+    rtc.time.second = 0;
+    rtc.time.recalc_timestamp_local();
+  }
+
+  time::RealTimeClock rtc;
+  http_request::HttpRequestComponent http;
+  ReplayServer server;
+
+ protected:
+  std::vector<std::unique_ptr<MoenvAQI>> instances_;
+};
+
+}  // namespace testing
+}  // namespace moenv_aqi
+}  // namespace esphome
@@ -0,0 +1,148 @@
+// RecordHistory and its RollingSeries against a rescan of the samples in the window:
+// random hourly sequences with missed and repeated hours, every window up to the
+// capacity, and a restore from the persisted ring, with the same or a smaller window
+
+#include <random>
+
+#include "fixture.h"
+
+using namespace esphome;
+using namespace esphome::moenv_aqi;
+
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-non-const-global-variables)
+static std::mt19937 rng(20261018);
+
+static uint32_t uniform(uint32_t low, uint32_t high) { return std::uniform_int_distribution<uint32_t>(low, high)(rng); }
+
+// The samples a window of this many hours keeps, out of an accepted sequence
+static std::vector<HistorySample> in_window(const std::vector<HistorySample> &samples, size_t window) {
+  std::vector<HistorySample> kept;
+  if (samples.empty()) return kept;
+  const uint32_t latest = samples.back().hour;
+  for (const HistorySample &sample : samples) {
+    if (sample.hour + window > latest) kept.push_back(sample);
+  }
+  return kept;
+}
+
+template<typename Metric> static HistoryStats rescan(const std::vector<HistorySample> &samples, Metric metric) {
+  HistoryStats stats;
+  stats.count = samples.size();
+  if (samples.empty()) return stats;
+  int64_t n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+  int64_t min = INT64_MAX, max = INT64_MIN;
+  for (const HistorySample &sample : samples) {
+    const int64_t x = sample.hour - samples.front().hour;
+    const int64_t y = metric(sample);
+    n++;
+    sx += x;
+    sy += y;
+    sxx += x * x;
+    sxy += x * y;
+    min = std::min(min, y);
+    max = std::max(max, y);
+  }
+  stats.min = min;
+  stats.max = max;
+  stats.mean = static_cast<float>(static_cast<double>(sy) / n);
+  if (n * sxx - sx * sx != 0) {
+    stats.slope = static_cast<float>(static_cast<double>(n * sxy - sx * sy) / (n * sxx - sx * sx));
+  }
+  return stats;
+}
+
+// Every figure is computed from exact integer sums, so the two must agree bit for bit
+static bool same(float a, float b) { return (std::isnan(a) && std::isnan(b)) || a == b; }
+
+static bool same(const HistoryStats &a, const HistoryStats &b) {
+  return a.count == b.count && same(a.min, b.min) && same(a.max, b.max) && same(a.mean, b.mean) &&
+         same(a.slope, b.slope);
+}
+
+template<size_t N>
+static void check_history(const RecordHistory<N> &history, const std::vector<HistorySample> &samples) {
+  const std::vector<HistorySample> kept = in_window(samples, history.get_window());
+  CHECK(history.size() == kept.size());
+  for (size_t i = 0; i < kept.size(); i++) {
+    CHECK(history.at(i).hour == kept[i].hour && history.at(i).aqi == kept[i].aqi &&
+          history.at(i).pm2_5 == kept[i].pm2_5);
+  }
+  CHECK(same(history.aqi_stats(), rescan(kept, [](const HistorySample &s) { return s.aqi; })));
+  CHECK(same(history.pm2_5_stats(), rescan(kept, [](const HistorySample &s) { return s.pm2_5; })));
+}
+
+template<size_t N> static void restore_and_check(const RecordHistory<N> &history, size_t window) {
+  RecordHistory<N> restored;
+  restored.set_window(window);
+  restored.restore(history.get_store());
+  std::vector<HistorySample> stored;
+  for (size_t i = 0; i < history.size(); i++) stored.push_back(history.at(i));
+  check_history(restored, stored);
+}
+
+// One random sequence: mostly hourly, with repeated or older hours that must be rejected
+// and gaps that evict more than one sample, some longer than the whole window
+template<size_t N> static void run_sequence() {
+  RecordHistory<N> history;
+  const size_t window = uniform(1, N);
+  history.set_window(window);
+  CHECK(history.empty() && history.aqi_stats().count == 0 && std::isnan(history.aqi_stats().mean));
+
+  std::vector<HistorySample> accepted;
+  uint32_t hour = 494000 + uniform(0, 1000);
+  const uint32_t length = uniform(1, 4 * N);
+  for (uint32_t i = 0; i < length; i++) {
+    const uint32_t roll = uniform(0, 99);
+    if (roll < 5 && hour > 0) {
+      hour -= uniform(0, 2);
+    } else if (roll < 20) {
+      hour += uniform(2, roll < 8 ? 2 * N : 4);
+    } else {
+      hour += 1;
+    }
+    // Small ranges make ties, which the monotonic deques must keep in order
+    const uint16_t limit = roll % 2 ? 5 : 500;
+    const HistorySample sample{hour, static_cast<uint16_t>(uniform(0, limit)),
+                               static_cast<uint16_t>(uniform(0, limit))};
+    const bool newer = accepted.empty() || sample.hour > accepted.back().hour;
+    CHECK(history.add(sample) == newer);
+    if (newer) accepted.push_back(sample);
+    check_history(history, accepted);
+
+    if (uniform(0, 15) == 0) {
+      restore_and_check(history, window);
+      restore_and_check(history, uniform(1, window));
+    }
+  }
+}
+
+int main() {
+  for (int i = 0; i < 2000; i++) {
+    run_sequence<5>();
+    run_sequence<MOENV_AQI_HISTORY_SIZE>();
+  }
+  run_sequence<168>();
+
+  // The window is clamped to the capacity, and one sample has no trend
+  RecordHistory<4> history;
+  history.set_window(0);
+  CHECK(history.get_window() == 1);
+  history.set_window(10);
+  CHECK(history.get_window() == 4);
+  CHECK(history.add({100, 50, 10}));
+  CHECK(history.aqi_stats().count == 1 && history.aqi_stats().mean == 50 && std::isnan(history.aqi_stats().slope));
+
+  // A corrupt store restores an empty history
+  RecordHistory<4>::Store store = history.get_store();
+  store.head = 4;
+  RecordHistory<4> restored;
+  restored.restore(store);
+  CHECK(restored.empty() && restored.aqi_stats().count == 0);
+  store.head = 0;
+  store.count = 5;
+  restored.restore(store);
+  CHECK(restored.empty());
+
+  puts("history_test: OK");
+  return 0;
+}
@@ -0,0 +1,223 @@
+// Host implementations of the ESPHome and ESP-IDF functions the component calls
+
+#include "host_runtime.h"
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include <esp_heap_caps.h>
+#include <esp_random.h>
+#include <esp_system.h>
+
+extern "C" {
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t count, size_t size);
+void *__wrap_realloc(void *ptr, size_t size);
+}
+
+#include "esphome/components/network/util.h"
+#include "esphome/core/application.h"
+#include "esphome/core/component.h"
+#include "esphome/core/hal.h"
+#include "esphome/core/helpers.h"
+#include "esphome/core/log.h"
+#include "esphome/core/preferences.h"
+
+namespace esphome {
+
+static uint64_t current_us = 1000000;
+static bool network_connected = true;
+
+uint32_t millis() { return static_cast<uint32_t>(current_us / 1000); }
+uint32_t micros() { return static_cast<uint32_t>(current_us); }
+void yield() {}
+
+static int initial_log_level() {
+  const char *level = getenv("MOENV_HOST_LOG_LEVEL");
+  return level != nullptr ? atoi(level) : HOST_LOG_WARN;
+}
+
+int host_log_level = initial_log_level();  // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+void host_log(int level, const char *tag, const char *format, ...) {
+  if (level > host_log_level) return;
+  static const char LETTERS[] = "?EWICDV";
+  printf("[%c][%s] ", LETTERS[level], tag);
+  va_list args;
+  va_start(args, format);
+  vprintf(format, args);
+  va_end(args);
+  printf("\n");
+}
+
+uint32_t fnv1_hash(const std::string &str) {
+  uint32_t hash = 2166136261UL;
+  for (char c : str) {
+    hash *= 16777619UL;
+    hash ^= static_cast<uint8_t>(c);
+  }
+  return hash;
+}
+std::string str_sanitize(const std::string &str) { return str; }
+std::string str_snake_case(const std::string &str) { return str; }
+
+static ESPPreferences preferences;
+ESPPreferences *global_preferences = &preferences;  // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+void Application::feed_wdt() {}
+const std::string &Application::get_friendly_name() {
+  static const std::string NAME = "host";
+  return NAME;
+}
+Application App;  // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+namespace network {
+bool is_connected() { return network_connected; }
+}  // namespace network
+
+namespace host_scheduler {
+
+struct Timeout {
+  Component *component;
+  std::string name;
+  uint64_t due_us;
+  uint64_t sequence;
+  std::function<void()> f;
+};
+
+static std::vector<Timeout> &timeouts() {
+  static std::vector<Timeout> items;
+  return items;
+}
+
+// Stands in for ESPHome's scheduler, so its storage is not charged to the component
+void set_timeout(Component *component, const std::string &name, uint32_t delay, std::function<void()> &&f) {
+  static uint64_t sequence = 0;
+  moenv_aqi::testing::UntrackedHeapScope untracked;
+  cancel_timeout(component, name);
+  timeouts().push_back(Timeout{component, name, current_us + delay * 1000ULL, sequence++, std::move(f)});
+}
+
+bool cancel_timeout(Component *component, const std::string &name) {
+  auto &items = timeouts();
+  for (auto it = items.begin(); it != items.end(); ++it) {
+    if (it->component == component && it->name == name) {
+      items.erase(it);
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace host_scheduler
+
+namespace moenv_aqi {
+namespace testing {
+
+void advance_time_us(uint64_t us) { current_us += us; }
+uint64_t now_us() { return current_us; }
+void set_network_connected(bool connected) { network_connected = connected; }
+
+void run_scheduler(std::vector<CallbackRun> *runs) {
+  auto &items = host_scheduler::timeouts();
+  while (!items.empty()) {
+    auto next = items.begin();
+    for (auto it = items.begin(); it != items.end(); ++it) {
+      if (it->due_us < next->due_us || (it->due_us == next->due_us && it->sequence < next->sequence)) next = it;
+    }
+    if (next->due_us > current_us) current_us = next->due_us;
+    host_scheduler::Timeout timeout = std::move(*next);
+    items.erase(next);
+
+    const uint32_t start = millis();
+    timeout.f();
+    if (runs != nullptr) {
+      UntrackedHeapScope untracked;
+      runs->push_back(CallbackRun{timeout.name, start, millis() - start});
+    }
+  }
+}
+
+// Every block carries its size and whether it is counted, so frees can be accounted for
+struct alignas(std::max_align_t) BlockHeader {
+  size_t size;
+  bool tracked;
+};
+
+static size_t in_use = 0;
+static size_t peak = 0;
+static uint64_t allocations = 0;
+static int untracked_depth = 0;
+
+size_t heap_in_use() { return in_use; }
+size_t heap_peak() { return peak; }
+void reset_heap_peak() { peak = in_use; }
+uint64_t allocation_count() { return allocations; }
+
+static void count_allocation() {
+  if (untracked_depth == 0) allocations++;
+}
+
+UntrackedHeapScope::UntrackedHeapScope() { untracked_depth++; }
+UntrackedHeapScope::~UntrackedHeapScope() { untracked_depth--; }
+
+static void *allocate(size_t size) {
+  auto *header = static_cast<BlockHeader *>(__real_malloc(sizeof(BlockHeader) + size));
+  if (header == nullptr) throw std::bad_alloc();
+  header->size = size;
+  header->tracked = untracked_depth == 0;
+  count_allocation();
+  if (header->tracked) {
+    in_use += size;
+    if (in_use > peak) peak = in_use;
+  }
+  return header + 1;
+}
+
+static void release(void *ptr) {
+  if (ptr == nullptr) return;
+  BlockHeader *header = static_cast<BlockHeader *>(ptr) - 1;
+  if (header->tracked) in_use -= header->size;
+  free(header);
+}
+
+}  // namespace testing
+}  // namespace moenv_aqi
+}  // namespace esphome
+
+// Linked with --wrap, so calls from the component and tests land here while libc and the
+// sanitizers keep the real functions. Blocks are left to the sanitizers rather than
+// tagged, since free() cannot tell them from ones libc allocated.
+void *__wrap_malloc(size_t size) {
+  esphome::moenv_aqi::testing::count_allocation();
+  return __real_malloc(size);
+}
+void *__wrap_calloc(size_t count, size_t size) {
+  esphome::moenv_aqi::testing::count_allocation();
+  return __real_calloc(count, size);
+}
+void *__wrap_realloc(void *ptr, size_t size) {
+  esphome::moenv_aqi::testing::count_allocation();
+  return __real_realloc(ptr, size);
+}
+
+void *operator new(size_t size) { return esphome::moenv_aqi::testing::allocate(size); }
+void *operator new[](size_t size) { return esphome::moenv_aqi::testing::allocate(size); }
+void operator delete(void *ptr) noexcept { esphome::moenv_aqi::testing::release(ptr); }
+void operator delete[](void *ptr) noexcept { esphome::moenv_aqi::testing::release(ptr); }
+void operator delete(void *ptr, size_t) noexcept { esphome::moenv_aqi::testing::release(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { esphome::moenv_aqi::testing::release(ptr); }
+
+uint32_t esp_random() { return 0; }
+
+uint32_t esp_get_free_heap_size() {
+  const size_t used = esphome::moenv_aqi::testing::heap_in_use();
+  return used < esphome::moenv_aqi::testing::HEAP_SIZE ? esphome::moenv_aqi::testing::HEAP_SIZE - used : 0;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps) { return esp_get_free_heap_size() / 2; }
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace esphome {
+namespace moenv_aqi {
+namespace testing {
+
+/// Move the simulated clock forward. Nothing on the host takes real time.
+void advance_time_us(uint64_t us);
+inline void advance_time(uint32_t ms) { advance_time_us(static_cast<uint64_t>(ms) * 1000); }
+uint64_t now_us();
+
+/// One scheduled callback run by run_scheduler(), in simulated time.
+struct CallbackRun {
+  std::string name;
+  uint32_t start_ms;
+  uint32_t duration_ms;
+};
+
+/// Run due and future timeouts in order, jumping the clock to each, until none is left.
+/// Every callback run is appended to runs, if given.
+void run_scheduler(std::vector<CallbackRun> *runs = nullptr);
+
+void set_network_connected(bool connected);
+
+/// Heap used by code under test: bytes allocated outside an UntrackedHeapScope and not
+/// yet freed. esp_get_free_heap_size() reports HEAP_SIZE minus this.
+constexpr size_t HEAP_SIZE = 200 * 1024;
+size_t heap_in_use();
+size_t heap_peak();
+void reset_heap_peak();
+
+/// Allocations made by code under test outside an UntrackedHeapScope: operator new, plus
+/// malloc, calloc and realloc, which the link wraps. Compare two readings around a pass.
+uint64_t allocation_count();
+
+/// Allocations made while one is alive are left out of the heap accounting, so the
+/// simulated network does not count against the device.
+class UntrackedHeapScope {
+ public:
+  UntrackedHeapScope();
+  ~UntrackedHeapScope();
+  UntrackedHeapScope(const UntrackedHeapScope &) = delete;
+  UntrackedHeapScope &operator=(const UntrackedHeapScope &) = delete;
+};
+
+}  // namespace testing
+}  // namespace moenv_aqi
+}  // namespace esphome
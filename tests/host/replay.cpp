@@ -0,0 +1,126 @@
+#include "replay.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "host_runtime.h"
+
+namespace esphome {
+namespace moenv_aqi {
+namespace testing {
+
+ReplayContainer::ReplayContainer(ReplayResponse response, size_t *bytes_sent)
+    : response_(std::move(response)), bytes_sent_(bytes_sent), next_chunk_us_(now_us() + response_.read_latency_us) {
+  this->status_code = response_.status;
+  this->content_length = response_.body.size();
+  this->response_headers_ = response_.headers;
+}
+
+// Chunks keep arriving from the time the response started, whether or not anyone reads,
+// until a receive window's worth is waiting. Back-to-back reads wait read_latency_us each;
+// a response read after other work, such as a prefetched page, has a head start.
+int ReplayContainer::read(uint8_t *buf, size_t max_len) {
+  const uint64_t buffered_us = static_cast<uint64_t>(response_.receive_window / std::max<size_t>(response_.chunk_size, 1)) *
+                               response_.read_latency_us;
+  if (now_us() > next_chunk_us_ + buffered_us) next_chunk_us_ = now_us() - buffered_us;
+  if (next_chunk_us_ > now_us()) advance_time_us(next_chunk_us_ - now_us());
+  next_chunk_us_ += response_.read_latency_us;
+
+  if (pos_ >= response_.fail_at) return -1;
+  if (pos_ >= response_.stall_at && stalled_ms_ < response_.stall_ms) {
+    advance_time(STALL_POLL_MS);
+    stalled_ms_ += STALL_POLL_MS;
+    next_chunk_us_ = now_us() + response_.read_latency_us;  // nothing arrives while quiet
+    return 0;
+  }
+
+  const size_t end = std::min(response_.body.size(), response_.cut_at);
+  if (pos_ >= end) {
+    complete_ = true;
+    return 0;
+  }
+  size_t n = std::min({max_len, response_.chunk_size, end - pos_});
+  if (response_.stall_at > pos_) n = std::min(n, response_.stall_at - pos_);
+  if (response_.fail_at > pos_) n = std::min(n, response_.fail_at - pos_);
+  memcpy(buf, response_.body.data() + pos_, n);
+  pos_ += n;
+  *bytes_sent_ += n;
+  return static_cast<int>(n);
+}
+
+static size_t query_number(const std::string &url, const char *name) {
+  const size_t pos = url.find(name);
+  return pos == std::string::npos ? 0 : strtoul(url.c_str() + pos + strlen(name), nullptr, 10);
+}
+
+std::shared_ptr<http_request::HttpContainer> ReplayServer::handle(const std::string &url,
+                                                                  const std::list<http_request::Header> &headers,
+                                                                  const std::set<std::string> &collect_headers) {
+  UntrackedHeapScope untracked;
+  advance_time(connect_ms);
+
+  Request request{millis(), query_number(url, "offset="), query_number(url, "limit="), false, 200};
+  bool not_modified = false;
+  for (const auto &header : headers) {
+    if (header.name == "If-None-Match" || header.name == "If-Modified-Since") request.conditional = true;
+    if (header.name == "If-None-Match" && !etag.empty() && header.value == etag) not_modified = true;
+  }
+
+  ReplayResponse response;
+  response.chunk_size = chunk_size;
+  response.read_latency_us = read_latency_us;
+  if (not_modified) {
+    response.status = 304;
+  } else {
+    response.body = this->page(request.offset, request.limit);
+  }
+  if (!etag.empty()) response.headers["etag"] = etag;
+  if (tamper) tamper(requests.size(), request, response);
+
+  // Like http_request, only hand back the headers the caller asked to collect
+  for (auto it = response.headers.begin(); it != response.headers.end();) {
+    it = collect_headers.count(it->first) != 0 ? std::next(it) : response.headers.erase(it);
+  }
+  if (response.status == 304) response.body.clear();
+
+  request.status = response.status;
+  requests.push_back(request);
+  auto container = std::make_shared<ReplayContainer>(std::move(response), &bytes_sent);
+  containers.push_back(container);
+  return container;
+}
+
+std::string ReplayServer::record(int index) const {
+  char buffer[640];
+  snprintf(buffer, sizeof(buffer),
+           "{\"sitename\":\"S%d\",\"county\":\"County\",\"aqi\":%d,\"pollutant\":\"\",\"status\":\"Good\","
+           "\"so2\":1.5,\"co\":0.2,\"o3\":%d,\"o3_8hr\":30,\"pm10\":20,\"pm2.5\":%d,\"no2\":5,\"nox\":6,"
+           "\"no\":0.5,\"wind_speed\":1.2,\"wind_direc\":90,\"publishtime\":\"%s\",\"co_8hr\":0.1,"
+           "\"pm2.5_avg\":7.5,\"pm10_avg\":18,\"so2_avg\":1.1,\"longitude\":121.5,\"latitude\":25.0,\"siteid\":%d",
+           index, 40 + index % 7, index % 50, 10 + index % 5, publish_time.c_str(), index);
+  std::string record = buffer;
+  if (padding > 0) {
+    record += ",\"note\":\"";
+    record.append(padding, 'x');
+    record += "\"";
+  }
+  record += "}";
+  return record;
+}
+
+std::string ReplayServer::page(size_t offset, size_t limit) const {
+  std::string body = "[";
+  const size_t end = std::min(offset + limit, static_cast<size_t>(sites));
+  for (size_t i = offset; i < end; i++) {
+    if (i > offset) body += ",";
+    body += this->record(static_cast<int>(i));
+  }
+  body += "]";
+  return body;
+}
+
+}  // namespace testing
+}  // namespace moenv_aqi
+}  // namespace esphome
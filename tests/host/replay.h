@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "esphome/components/http_request/http_request.h"
+
+namespace esphome {
+namespace moenv_aqi {
+namespace testing {
+
+/// A response as the replay server will play it back, with the faults to inject.
+struct ReplayResponse {
+  static constexpr size_t NEVER = SIZE_MAX;
+
+  int status{200};
+  std::string body;
+  std::map<std::string, std::string> headers;  // lower-case names
+  size_t chunk_size{512};                      // most bytes one read() returns
+  uint32_t read_latency_us{2000};              // time between chunks arriving
+  size_t receive_window{5760};                 // bytes that arrive while nobody reads (lwIP TCP_WND)
+  size_t stall_at{NEVER};                      // body offset where the connection goes quiet
+  uint32_t stall_ms{0};                        // how long it stays quiet
+  size_t fail_at{NEVER};                       // body offset where read() starts failing
+  size_t cut_at{NEVER};                        // body offset where the body ends early
+};
+
+/// Plays a ReplayResponse back through the HttpContainer interface in simulated time.
+class ReplayContainer : public http_request::HttpContainer {
+ public:
+  ReplayContainer(ReplayResponse response, size_t *bytes_sent);
+
+  int read(uint8_t *buf, size_t max_len) override;
+  void end() override { ended_ = true; }
+  bool is_read_complete() const override { return complete_; }
+
+  bool is_ended() const { return ended_; }
+
+ protected:
+  // A quiet connection returns no data for this long per read() call
+  static constexpr uint32_t STALL_POLL_MS = 10;
+
+  ReplayResponse response_;
+  size_t *bytes_sent_;
+  size_t pos_{0};
+  uint64_t next_chunk_us_;  // when the next chunk arrives, if nobody is waiting on it sooner
+  uint32_t stalled_ms_{0};
+  bool complete_{false};
+  bool ended_{false};
+};
+
+/// Stand-in for the MOENV endpoint: serves a synthetic dataset one page per request,
+/// answers conditional requests and lets each test reshape responses to inject faults.
+class ReplayServer {
+ public:
+  struct Request {
+    uint32_t time_ms;
+    size_t offset;
+    size_t limit;
+    bool conditional;
+    int status;
+  };
+
+  /// Adjusts the response to request number index (from 0) before it is played back.
+  using Tamper = std::function<void(size_t index, const Request &request, ReplayResponse &response)>;
+
+  std::shared_ptr<http_request::HttpContainer> handle(const std::string &url,
+                                                      const std::list<http_request::Header> &headers,
+                                                      const std::set<std::string> &collect_headers);
+
+  /// The record for the site named "S<index>".
+  std::string record(int index) const;
+  /// The body of the page starting at offset.
+  std::string page(size_t offset, size_t limit) const;
+
+  int sites{95};
+  std::string publish_time{"2026/10/18 10:00:00"};
+  std::string etag;     // sent with full responses when set; If-None-Match on it gets a 304
+  size_t padding{0};    // extra bytes per record, to grow the body
+  uint32_t connect_ms{60};  // time until the response headers arrive
+  size_t chunk_size{512};
+  uint32_t read_latency_us{2000};
+  Tamper tamper;
+
+  std::vector<Request> requests;
+  size_t bytes_sent{0};
+  std::vector<std::shared_ptr<ReplayContainer>> containers;
+};
+
+}  // namespace testing
+}  // namespace moenv_aqi
+}  // namespace esphome
@@ -0,0 +1,285 @@
+// Fault-injection scenarios for one lookup. Each prints the worst time the main loop was
+// blocked, when each attempt ran and how much heap the component used, for sizing
+// http_request's timeout and the watchdog_timeout. The prefetch scenario compares pass
+// time and requests with prefetch on and off.
+//
+//   moenv_aqi_scenarios [scenario]   run one scenario, or all of them
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "fixture.h"
+
+using namespace esphome;
+using namespace esphome::moenv_aqi;
+using namespace esphome::moenv_aqi::testing;
+
+namespace {
+
+struct Outcome {
+  bool success;
+  size_t requests;
+  uint32_t worst_blocking_ms;
+  uint32_t longest_stall_ms;
+  size_t heap_peak;
+  size_t heap_retained;
+  std::vector<CallbackRun> attempts;
+};
+
+// Run one update of the instance, with its retries, and report what it cost
+Outcome run_lookup(Device &device, MoenvAQI *instance) {
+  const int errors = instance->get_on_error_trigger()->count;
+  const size_t requests = device.server.requests.size();
+  const size_t heap_before = heap_in_use();
+  reset_heap_peak();
+
+  std::vector<CallbackRun> runs;
+  instance->update();
+  run_scheduler(&runs);
+
+  Outcome outcome{};
+  outcome.success = instance->get_on_error_trigger()->count == errors && !instance->get_data().site_name.empty();
+  outcome.requests = device.server.requests.size() - requests;
+  outcome.longest_stall_ms = Probe::worst_stall_ms(global_fetch_coordinator);
+  outcome.heap_peak = heap_peak() - heap_before;
+  outcome.heap_retained = heap_in_use() > heap_before ? heap_in_use() - heap_before : 0;
+  for (const auto &run : runs) {
+    outcome.worst_blocking_ms = std::max(outcome.worst_blocking_ms, run.duration_ms);
+    if (run.name == "moenv_fetch") outcome.attempts.push_back(run);
+  }
+  return outcome;
+}
+
+void report(const char *name, const Device &device, const Outcome &outcome) {
+  printf("== %s\n", name);
+  const uint32_t first = outcome.attempts.empty() ? 0 : outcome.attempts.front().start_ms;
+  for (size_t i = 0; i < outcome.attempts.size(); i++) {
+    const CallbackRun &attempt = outcome.attempts[i];
+    printf("  attempt %zu at %+7u ms, blocked %u ms\n", i + 1, attempt.start_ms - first, attempt.duration_ms);
+  }
+  printf("  %s after %zu request(s)\n", outcome.success ? "found" : "failed", outcome.requests);
+  printf("  worst blocking %u ms, longest read stall %u ms, http timeout %u ms\n", outcome.worst_blocking_ms,
+         outcome.longest_stall_ms, device.http.get_timeout());
+  printf("  heap peak %zu bytes, retained %zu bytes\n", outcome.heap_peak, outcome.heap_retained);
+}
+
+// Warm up so the report shows a steady-state lookup rather than first-use allocations
+MoenvAQI *prepare(Device &device, const std::string &site, uint32_t limit = 20) {
+  MoenvAQI *instance = device.add(site, limit);
+  instance->update();
+  run_scheduler();
+  device.server.publish_time = "2026/10/18 11:00:00";
+  device.set_time(11, 20);
+  return instance;
+}
+
+// Records arrive 32 bytes at a time, 25 ms apart
+void slow_drip() {
+  Device device;
+  MoenvAQI *instance = prepare(device, "S30");
+  device.server.chunk_size = 32;
+  device.server.read_latency_us = 25000;
+  const Outcome outcome = run_lookup(device, instance);
+  report("slow_drip", device, outcome);
+  CHECK(outcome.success && outcome.attempts.size() == 1);
+  CHECK(outcome.longest_stall_ms < device.http.get_timeout() / 2);
+}
+
+// The connection goes quiet in the middle of a record for less than the timeout
+void short_stall() {
+  Device device;
+  MoenvAQI *instance = prepare(device, "S15");
+  device.server.tamper = [](size_t, const ReplayServer::Request &request, ReplayResponse &response) {
+    response.stall_at = response.body.size() / 3;
+    response.stall_ms = 3000;
+  };
+  const Outcome outcome = run_lookup(device, instance);
+  report("short_stall", device, outcome);
+  CHECK(outcome.success && outcome.attempts.size() == 1);
+  CHECK(outcome.longest_stall_ms >= 3000 && outcome.worst_blocking_ms < 3000 + 1000);
+}
+
+// The connection goes quiet mid-record for longer than the timeout; the retry succeeds
+void mid_record_stall() {
+  Device device;
+  MoenvAQI *instance = prepare(device, "S15");
+  const size_t first = device.server.requests.size();
+  device.server.tamper = [first](size_t index, const ReplayServer::Request &request, ReplayResponse &response) {
+    if (index != first) return;
+    response.stall_at = response.body.size() / 3;
+    response.stall_ms = 60000;
+  };
+  const Outcome outcome = run_lookup(device, instance);
+  report("mid_record_stall", device, outcome);
+  CHECK(outcome.success && outcome.attempts.size() == 2);
+  CHECK(outcome.longest_stall_ms >= device.http.get_timeout());
+  CHECK(outcome.attempts[1].start_ms - outcome.attempts[0].start_ms >= 1000);
+}
+
+// The body ends cleanly but in the middle of a record; the retry reads the whole page
+void truncated_body() {
+  Device device;
+  MoenvAQI *instance = prepare(device, "S15");
+  const size_t first = device.server.requests.size();
+  device.server.tamper = [first](size_t index, const ReplayServer::Request &request, ReplayResponse &response) {
+    if (index == first) response.cut_at = response.body.size() / 2 + 7;
+  };
+  const Outcome outcome = run_lookup(device, instance);
+  report("truncated_body", device, outcome);
+  CHECK(outcome.success && outcome.attempts.size() == 2 && outcome.requests == 2);
+}
+
+// A record on the page before the site's cannot be parsed; it is skipped, and the short
+// count of records must not be taken for the end of the data
+void malformed_json() {
+  Device device;
+  prepare(device, "S1");
+  MoenvAQI *instance = device.add("S30");
+  device.server.tamper = [](size_t, const ReplayServer::Request &request, ReplayResponse &response) {
+    const size_t pos = response.body.find("\"aqi\":");
+    if (request.offset == 0 && pos != std::string::npos) response.body.replace(pos + 6, 2, "?!");
+  };
+  const Outcome outcome = run_lookup(device, instance);
+  report("malformed_json", device, outcome);
+  CHECK(outcome.success && outcome.attempts.size() == 1 && outcome.requests == 2);
+}
+
+// A record on the page before the site's has a numeric sitename; it is skipped like a
+// null one, and still counts towards the page
+void numeric_sitename() {
+  Device device;
+  prepare(device, "S1");
+  MoenvAQI *instance = device.add("S30");
+  device.server.tamper = [](size_t, const ReplayServer::Request &request, ReplayResponse &response) {
+    const size_t pos = response.body.find("\"sitename\":\"S15\"");
+    if (pos != std::string::npos) response.body.replace(pos, 16, "\"sitename\":15");
+  };
+  const Outcome outcome = run_lookup(device, instance);
+  report("numeric_sitename", device, outcome);
+  CHECK(outcome.success && outcome.attempts.size() == 1 && outcome.requests == 2);
+}
+
+// The first page of an unchanged snapshot starts with a numeric publishtime, which cannot
+// be compared with the stored one; the probe settles the lookup on the next page instead
+void numeric_publish_time() {
+  Device device;
+  MoenvAQI *instance = prepare(device, "S30");
+  device.set_time(10, 20);
+  device.server.publish_time = "2026/10/18 10:00:00";
+  device.server.tamper = [](size_t, const ReplayServer::Request &request, ReplayResponse &response) {
+    const size_t pos = response.body.find("\"publishtime\":\"");
+    if (request.offset == 0 && pos != std::string::npos) response.body.replace(pos + 14, 21, "2026");
+  };
+  Probe::last_successful_offset(instance) = 0;
+  const Outcome outcome = run_lookup(device, instance);
+  report("numeric_publish_time", device, outcome);
+  CHECK(outcome.success && outcome.attempts.size() == 1 && outcome.requests == 2);
+  CHECK(Probe::probe_hits(instance) == 1);
+}
+
+// The server answers 503 twice; the retries back off and the third attempt succeeds
+void non_200() {
+  Device device;
+  MoenvAQI *instance = prepare(device, "S15");
+  const size_t first = device.server.requests.size();
+  device.server.tamper = [first](size_t index, const ReplayServer::Request &request, ReplayResponse &response) {
+    if (index < first + 2) {
+      response.status = 503;
+      response.body = "Service Unavailable";
+    }
+  };
+  const Outcome outcome = run_lookup(device, instance);
+  report("non_200", device, outcome);
+  CHECK(outcome.success && outcome.attempts.size() == 3);
+  CHECK(outcome.attempts[1].start_ms - outcome.attempts[0].start_ms >= 1000);
+  CHECK(outcome.attempts[2].start_ms - outcome.attempts[1].start_ms >= 2000);
+}
+
+// 100 records of about 2 kB per page; heap use must not grow with the body
+void large_body() {
+  Device device;
+  device.server.sites = 500;
+  device.server.padding = 1500;
+  MoenvAQI *instance = prepare(device, "S250", 100);
+  const Outcome outcome = run_lookup(device, instance);
+  report("large_body", device, outcome);
+  CHECK(outcome.success && outcome.requests == 1);
+  CHECK(device.server.bytes_sent > 100 * 1500);
+  CHECK(outcome.heap_peak < 16 * 1024);
+}
+
+// A first lookup of a site on the last of five pages, with prefetch off and then on, over
+// a fast link and a slow one. Prefetching overlaps each page's connection with reading the
+// page before it, at the cost of one request past the site's page.
+void prefetch() {
+  struct Link {
+    const char *name;
+    uint32_t connect_ms;
+    uint32_t read_latency_us;
+  };
+  const Link links[] = {{"fast", 60, 2000}, {"slow", 400, 20000}};
+
+  Device device;
+  printf("== prefetch\n");
+  int site = 90;  // S90 to S93 are all on the last page
+  for (const Link &link : links) {
+    device.server.connect_ms = link.connect_ms;
+    device.server.read_latency_us = link.read_latency_us;
+    Outcome outcomes[2];
+    for (bool prefetch : {false, true}) {
+      MoenvAQI *instance = device.add("S" + std::to_string(site++));
+      instance->set_prefetch(prefetch);
+      Outcome &outcome = outcomes[prefetch];
+      outcome = run_lookup(device, instance);
+      CHECK(outcome.success && outcome.attempts.size() == 1);
+      printf("  %s link, prefetch %-3s: pass %5u ms, %zu request(s)\n", link.name, prefetch ? "on" : "off",
+             outcome.attempts[0].duration_ms, outcome.requests);
+    }
+    const Outcome &off = outcomes[0];
+    const Outcome &on = outcomes[1];
+    CHECK(on.attempts[0].duration_ms < off.attempts[0].duration_ms);
+    CHECK(on.requests <= off.requests + 1);
+  }
+}
+
+struct Scenario {
+  const char *name;
+  void (*run)();
+};
+
+const Scenario SCENARIOS[] = {
+    {"slow_drip", slow_drip},   {"short_stall", short_stall}, {"mid_record_stall", mid_record_stall},
+    {"truncated_body", truncated_body}, {"malformed_json", malformed_json},
+    {"numeric_sitename", numeric_sitename}, {"numeric_publish_time", numeric_publish_time}, {"non_200", non_200},
+    {"large_body", large_body}, {"prefetch", prefetch},
+};
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  for (const Scenario &scenario : SCENARIOS) {
+    if (argc > 1 && strcmp(argv[1], scenario.name) == 0) {
+      scenario.run();
+      return 0;
+    }
+  }
+  if (argc > 1) {
+    fprintf(stderr, "unknown scenario: %s\n", argv[1]);
+    return 1;
+  }
+
+  // The coordinator is a process-wide singleton; give each scenario a fresh one
+  int failed = 0;
+  for (const Scenario &scenario : SCENARIOS) {
+    fflush(stdout);
+    const pid_t pid = fork();
+    if (pid == 0) {
+      scenario.run();
+      exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) failed++;
+  }
+  return failed == 0 ? 0 : 1;
+}
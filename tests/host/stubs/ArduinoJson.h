@@ -0,0 +1,312 @@
+#pragma once
+
+// Just enough of ArduinoJson 7 to parse flat records from HttpStreamAdapter. Like the real
+// library, all document memory comes from the document's Allocator: member slots in fixed
+// pools, and strings built by growing the newest block, then shrunk to fit. clear()
+// releases everything. Set MOENV_AQI_ARDUINOJSON_DIR to build against the real library.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+namespace ArduinoJson {
+
+class Allocator {
+ public:
+  virtual void *allocate(size_t size) = 0;
+  virtual void deallocate(void *ptr) = 0;
+  virtual void *reallocate(void *ptr, size_t new_size) = 0;
+
+ protected:
+  ~Allocator() = default;
+};
+
+namespace detail {
+
+class DefaultAllocator : public Allocator {
+ public:
+  void *allocate(size_t size) override { return malloc(size); }
+  void deallocate(void *ptr) override { free(ptr); }
+  void *reallocate(void *ptr, size_t new_size) override { return realloc(ptr, new_size); }
+
+  static Allocator *instance() {
+    static DefaultAllocator allocator;
+    return &allocator;
+  }
+};
+
+struct Slot {
+  enum Type : uint8_t { NUL, STRING, NUMBER };
+
+  const char *key;
+  const char *string;
+  double number;
+  Type type;
+};
+
+struct Pool {
+  static constexpr size_t CAPACITY = 16;
+
+  Pool *next;
+  size_t used;
+  Slot slots[CAPACITY];
+};
+
+struct StringNode {
+  StringNode *next;
+  char data[1];
+};
+
+}  // namespace detail
+
+class JsonVariant {
+ public:
+  JsonVariant() = default;
+  explicit JsonVariant(const detail::Slot *slot) : slot_(slot) {}
+
+  template<typename T> T as() const;
+  template<typename T> bool is() const;
+
+  bool isNull() const { return slot_ == nullptr || slot_->type == detail::Slot::NUL; }
+  explicit operator bool() const { return !this->isNull(); }
+
+ protected:
+  double number_() const {
+    if (slot_ == nullptr) return 0;
+    if (slot_->type == detail::Slot::NUMBER) return slot_->number;
+    if (slot_->type == detail::Slot::STRING) return atof(slot_->string);
+    return 0;
+  }
+
+  const detail::Slot *slot_{nullptr};
+};
+
+template<> inline const char *JsonVariant::as<const char *>() const {
+  return slot_ != nullptr && slot_->type == detail::Slot::STRING ? slot_->string : nullptr;
+}
+template<> inline std::string JsonVariant::as<std::string>() const {
+  if (this->isNull()) return "null";
+  if (slot_->type == detail::Slot::STRING) return slot_->string;
+  return std::to_string(slot_->number);
+}
+template<> inline double JsonVariant::as<double>() const { return this->number_(); }
+template<> inline float JsonVariant::as<float>() const { return static_cast<float>(this->number_()); }
+template<> inline int JsonVariant::as<int>() const { return static_cast<int>(this->number_()); }
+
+template<> inline bool JsonVariant::is<const char *>() const {
+  return slot_ != nullptr && slot_->type == detail::Slot::STRING;
+}
+template<> inline bool JsonVariant::is<double>() const {
+  return slot_ != nullptr && slot_->type == detail::Slot::NUMBER;
+}
+
+class JsonDocument {
+ public:
+  explicit JsonDocument(Allocator *allocator = nullptr)
+      : allocator_(allocator != nullptr ? allocator : detail::DefaultAllocator::instance()) {}
+  ~JsonDocument() { this->clear(); }
+  JsonDocument(const JsonDocument &) = delete;
+  JsonDocument &operator=(const JsonDocument &) = delete;
+
+  JsonVariant operator[](std::string_view key) const {
+    for (const detail::Pool *pool = pools_; pool != nullptr; pool = pool->next) {
+      for (size_t i = 0; i < pool->used; i++) {
+        if (key == pool->slots[i].key) return JsonVariant(&pool->slots[i]);
+      }
+    }
+    return JsonVariant();
+  }
+  JsonVariant operator[](const char *key) const { return (*this)[std::string_view(key)]; }
+
+  /// Release every slot and string, newest first.
+  void clear() {
+    while (strings_ != nullptr) {
+      detail::StringNode *next = strings_->next;
+      allocator_->deallocate(strings_);
+      strings_ = next;
+    }
+    while (pools_ != nullptr) {
+      detail::Pool *next = pools_->next;
+      allocator_->deallocate(pools_);
+      pools_ = next;
+    }
+    overflowed_ = false;
+  }
+
+  bool overflowed() const { return overflowed_; }
+
+  // Used by deserializeJson()
+  detail::Slot *add_slot_() {
+    if (pools_ == nullptr || pools_->used == detail::Pool::CAPACITY) {
+      auto *pool = static_cast<detail::Pool *>(allocator_->allocate(sizeof(detail::Pool)));
+      if (pool == nullptr) return this->fail_();
+      pool->next = pools_;
+      pool->used = 0;
+      pools_ = pool;
+    }
+    detail::Slot *slot = &pools_->slots[pools_->used++];
+    *slot = detail::Slot{"", "", 0, detail::Slot::NUL};
+    return slot;
+  }
+
+  /// Append a character to the string being built, growing its block as needed.
+  bool append_(char c) {
+    if (building_ == nullptr || building_length_ + 1 >= building_capacity_) {
+      const size_t capacity = building_ == nullptr ? INITIAL_STRING_CAPACITY : building_capacity_ * 2;
+      void *block = building_ == nullptr ? allocator_->allocate(node_size_(capacity))
+                                         : allocator_->reallocate(building_, node_size_(capacity));
+      if (block == nullptr) return this->fail_() != nullptr;
+      building_ = static_cast<detail::StringNode *>(block);
+      building_capacity_ = capacity;
+    }
+    building_->data[building_length_++] = c;
+    return true;
+  }
+
+  /// Shrink the built string to fit and keep it until clear().
+  const char *save_string_() {
+    if (building_ == nullptr && !this->append_('\0')) return nullptr;
+    if (building_length_ == 0 || building_->data[building_length_ - 1] != '\0') building_->data[building_length_++] = '\0';
+    auto *node = static_cast<detail::StringNode *>(allocator_->reallocate(building_, node_size_(building_length_)));
+    if (node == nullptr) node = building_;
+    node->next = strings_;
+    strings_ = node;
+    building_ = nullptr;
+    building_length_ = 0;
+    building_capacity_ = 0;
+    return node->data;
+  }
+
+  void discard_string_() {
+    if (building_ != nullptr) allocator_->deallocate(building_);
+    building_ = nullptr;
+    building_length_ = 0;
+    building_capacity_ = 0;
+  }
+
+ protected:
+  static constexpr size_t INITIAL_STRING_CAPACITY = 31;
+
+  static size_t node_size_(size_t length) { return offsetof(detail::StringNode, data) + length; }
+
+  detail::Slot *fail_() {
+    overflowed_ = true;
+    return nullptr;
+  }
+
+  Allocator *allocator_;
+  detail::Pool *pools_{nullptr};
+  detail::StringNode *strings_{nullptr};
+  detail::StringNode *building_{nullptr};
+  size_t building_length_{0};
+  size_t building_capacity_{0};
+  bool overflowed_{false};
+};
+
+class DeserializationError {
+ public:
+  enum Code { Ok, EmptyInput, IncompleteInput, InvalidInput, NoMemory, TooDeep };
+
+  DeserializationError(Code code = Ok) : code_(code) {}  // NOLINT(google-explicit-constructor)
+
+  Code code() const { return code_; }
+  const char *c_str() const {
+    static const char *const NAMES[] = {"Ok", "EmptyInput", "IncompleteInput", "InvalidInput", "NoMemory", "TooDeep"};
+    return NAMES[code_];
+  }
+  explicit operator bool() const { return code_ != Ok; }
+  bool operator==(Code code) const { return code_ == code; }
+
+ protected:
+  Code code_;
+};
+
+namespace detail {
+
+template<typename Reader> int skip_spaces(Reader &input) {
+  int c;
+  do {
+    c = input.read();
+  } while (c == ' ' || c == '\n' || c == '\r' || c == '\t');
+  return c;
+}
+
+// Read the rest of a quoted string into the document's string builder
+template<typename Reader> DeserializationError read_string(JsonDocument &doc, Reader &input, const char **out) {
+  int c;
+  while ((c = input.read()) != '"') {
+    if (c == -1) return DeserializationError::IncompleteInput;
+    if (!doc.append_(static_cast<char>(c))) return DeserializationError::NoMemory;
+  }
+  *out = doc.save_string_();
+  return *out != nullptr ? DeserializationError::Ok : DeserializationError::NoMemory;
+}
+
+template<typename Reader> DeserializationError parse_object(JsonDocument &doc, Reader &input) {
+  int c = skip_spaces(input);
+  if (c == -1) return DeserializationError::EmptyInput;
+  if (c != '{') return DeserializationError::InvalidInput;
+
+  while (true) {
+    c = skip_spaces(input);
+    if (c == ',') c = skip_spaces(input);
+    if (c == -1) return DeserializationError::IncompleteInput;
+    if (c == '}') return DeserializationError::Ok;
+    if (c != '"') return DeserializationError::InvalidInput;
+
+    Slot *slot = doc.add_slot_();
+    if (slot == nullptr) return DeserializationError::NoMemory;
+    DeserializationError error = read_string(doc, input, &slot->key);
+    if (error) return error;
+    c = skip_spaces(input);
+    if (c != ':') return c == -1 ? DeserializationError::IncompleteInput : DeserializationError::InvalidInput;
+
+    c = skip_spaces(input);
+    if (c == '"') {
+      slot->type = Slot::STRING;
+      error = read_string(doc, input, &slot->string);
+      if (error) return error;
+    } else if (c == 'n') {
+      for (const char expected : {'u', 'l', 'l'}) {
+        c = input.read();
+        if (c == -1) return DeserializationError::IncompleteInput;
+        if (c != expected) return DeserializationError::InvalidInput;
+      }
+    } else if (c == '-' || (c >= '0' && c <= '9')) {
+      char number[32];
+      size_t length = 0;
+      number[length++] = static_cast<char>(c);
+      while (true) {
+        c = input.peek();
+        if (c == -1) return DeserializationError::IncompleteInput;
+        if (!(c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E' || (c >= '0' && c <= '9'))) break;
+        if (length + 1 == sizeof(number)) return DeserializationError::InvalidInput;
+        number[length++] = static_cast<char>(input.read());
+      }
+      number[length] = '\0';
+      slot->type = Slot::NUMBER;
+      slot->number = atof(number);
+    } else {
+      return c == -1 ? DeserializationError::IncompleteInput : DeserializationError::InvalidInput;
+    }
+  }
+}
+
+}  // namespace detail
+
+/// Parses one flat object of strings, numbers and nulls, reading no further than its
+/// closing brace, like ArduinoJson does on a stream.
+template<typename Reader> DeserializationError deserializeJson(JsonDocument &doc, Reader &input) {
+  doc.clear();
+  DeserializationError error = detail::parse_object(doc, input);
+  doc.discard_string_();
+  if (!error && doc.overflowed()) error = DeserializationError::NoMemory;
+  return error;
+}
+
+}  // namespace ArduinoJson
+
+using namespace ArduinoJson;  // NOLINT(google-global-names-in-headers)
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <cstdint>
+
+// Backed by the host heap accounting in host_runtime.cpp
+uint32_t esp_get_free_heap_size();
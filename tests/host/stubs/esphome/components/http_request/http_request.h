@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+
+#include "esphome/core/component.h"
+#include "esphome/core/hal.h"
+
+namespace esphome {
+namespace http_request {
+
+struct Header {
+  std::string name;
+  std::string value;
+};
+
+class HttpContainer {
+ public:
+  virtual ~HttpContainer() = default;
+
+  virtual int read(uint8_t *buf, size_t max_len) = 0;
+  virtual void end() = 0;
+  virtual bool is_read_complete() const { return false; }
+
+  /// Only headers named in the request's collect set are kept, in lower case.
+  std::string get_response_header(const std::string &header_name) {
+    auto it = response_headers_.find(header_name);
+    return it == response_headers_.end() ? std::string() : it->second;
+  }
+
+  size_t content_length{0};
+  int status_code{0};
+  std::map<std::string, std::string> response_headers_;
+};
+
+enum class HttpReadLoopResult : uint8_t { DATA, COMPLETE, RETRY, ERROR, TIMEOUT };
+
+inline HttpReadLoopResult http_read_loop_result(int bytes_read, uint32_t &last_data_time, uint32_t timeout_ms,
+                                                bool is_read_complete) {
+  if (bytes_read > 0) {
+    last_data_time = millis();
+    return HttpReadLoopResult::DATA;
+  }
+  if (bytes_read < 0) return HttpReadLoopResult::ERROR;
+  if (is_read_complete) return HttpReadLoopResult::COMPLETE;
+  if (millis() - last_data_time >= timeout_ms) return HttpReadLoopResult::TIMEOUT;
+  return HttpReadLoopResult::RETRY;
+}
+
+/// Hands every request to a handler installed by the test.
+class HttpRequestComponent : public Component {
+ public:
+  using Handler = std::function<std::shared_ptr<HttpContainer>(const std::string &url, const std::list<Header> &headers,
+                                                               const std::set<std::string> &collect_headers)>;
+
+  void set_handler(Handler handler) { handler_ = std::move(handler); }
+  void set_timeout(uint32_t timeout) { timeout_ = timeout; }
+  uint32_t get_timeout() const { return timeout_; }
+
+  std::shared_ptr<HttpContainer> get(const std::string &url) { return handler_(url, {}, {}); }
+  std::shared_ptr<HttpContainer> get(const std::string &url, const std::list<Header> &request_headers) {
+    return handler_(url, request_headers, {});
+  }
+  std::shared_ptr<HttpContainer> get(const std::string &url, const std::list<Header> &request_headers,
+                                     const std::set<std::string> &collect_headers) {
+    return handler_(url, request_headers, collect_headers);
+  }
+
+ protected:
+  Handler handler_;
+  uint32_t timeout_{4500};
+};
+
+}  // namespace http_request
+}  // namespace esphome
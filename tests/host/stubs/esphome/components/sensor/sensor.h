@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cmath>
+
+namespace esphome {
+namespace sensor {
+
+class Sensor {
+ public:
+  void publish_state(float state) {
+    this->state = state;
+    publishes++;
+  }
+
+  float state{NAN};
+  int publishes{0};
+};
+
+}  // namespace sensor
+}  // namespace esphome
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+
+namespace esphome {
+namespace text_sensor {
+
+class TextSensor {
+ public:
+  void publish_state(const std::string &state) {
+    this->state = state;
+    publishes++;
+  }
+
+  std::string state;
+  int publishes{0};
+};
+
+}  // namespace text_sensor
+}  // namespace esphome
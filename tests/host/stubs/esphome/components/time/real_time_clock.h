@@ -0,0 +1,17 @@
+#pragma once
+
+#include "esphome/core/time.h"
+
+namespace esphome {
+namespace time {
+
+/// Returns whatever time the test set.
+class RealTimeClock {
+ public:
+  ESPTime now() { return time; }
+
+  ESPTime time{};
+};
+
+}  // namespace time
+}  // namespace esphome
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+
+#include "esphome/core/helpers.h"
+
+namespace esphome {
+
+class Application {
+ public:
+  void feed_wdt();
+  const std::string &get_friendly_name();
+};
+
+extern Application App;  // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+}  // namespace esphome
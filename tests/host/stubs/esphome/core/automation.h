@@ -0,0 +1,39 @@
+#pragma once
+
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+namespace esphome {
+
+/// Counts how often it fired instead of running actions.
+template<typename... Ts> class Trigger {
+ public:
+  void trigger(Ts... x) { count++; }
+
+  int count{0};
+};
+
+/// A constant or a lambda, returned by value like ESPHome's TemplatableValue.
+template<typename T, typename... X> class TemplatableValue {
+ public:
+  TemplatableValue() = default;
+
+  template<typename V, typename std::enable_if<!std::is_invocable<V, X...>::value, int>::type = 0>
+  TemplatableValue(V value) : type_(VALUE), value_(std::move(value)) {}  // NOLINT(google-explicit-constructor)
+
+  template<typename F, typename std::enable_if<std::is_invocable<F, X...>::value, int>::type = 0>
+  TemplatableValue(F f) : type_(LAMBDA), f_(std::move(f)) {}  // NOLINT(google-explicit-constructor)
+
+  bool has_value() const { return type_ != NONE; }
+  bool is_static() const { return type_ == VALUE; }
+
+  T value(X... x) const { return type_ == LAMBDA ? f_(x...) : value_; }
+
+ protected:
+  enum { NONE, VALUE, LAMBDA } type_{NONE};
+  T value_{};
+  std::function<T(X...)> f_;
+};
+
+}  // namespace esphome
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "esphome/core/hal.h"
+#include "esphome/core/log.h"
+
+namespace esphome {
+
+namespace setup_priority {
+inline constexpr float LATE = -100.0f;
+}  // namespace setup_priority
+
+static const uint32_t SCHEDULER_DONT_RUN = 4294967295UL;
+
+class Component;
+
+namespace host_scheduler {
+// Named timeouts, replaced by name per component like ESPHome's scheduler
+void set_timeout(Component *component, const std::string &name, uint32_t delay, std::function<void()> &&f);
+bool cancel_timeout(Component *component, const std::string &name);
+}  // namespace host_scheduler
+
+class Component {
+ public:
+  virtual ~Component() = default;
+  virtual void setup() {}
+  virtual void dump_config() {}
+  virtual float get_setup_priority() const { return 0.0f; }
+
+  bool is_warning() const { return warning_; }
+
+ protected:
+  void set_timeout(const std::string &name, uint32_t timeout, std::function<void()> &&f) {
+    host_scheduler::set_timeout(this, name, timeout, std::move(f));
+  }
+  bool cancel_timeout(const std::string &name) { return host_scheduler::cancel_timeout(this, name); }
+  void defer(const std::string &name, std::function<void()> &&f) { this->set_timeout(name, 0, std::move(f)); }
+  void status_set_warning(const char *message = nullptr) { warning_ = true; }
+  void status_clear_warning() { warning_ = false; }
+
+  bool warning_{false};
+};
+
+class PollingComponent : public Component {
+ public:
+  virtual void update() = 0;
+
+  void set_update_interval(uint32_t update_interval) { update_interval_ = update_interval; }
+  uint32_t get_update_interval() const { return update_interval_; }
+
+ protected:
+  uint32_t update_interval_{60000};
+};
+
+}  // namespace esphome
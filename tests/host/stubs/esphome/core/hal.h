@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdint>
+
+namespace esphome {
+
+// Simulated clock, advanced by the replay harness rather than by real time
+uint32_t millis();
+uint32_t micros();
+void yield();
+
+}  // namespace esphome
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "esphome/core/hal.h"
+
+namespace esphome {
+
+uint32_t fnv1_hash(const std::string &str);
+std::string str_sanitize(const std::string &str);
+std::string str_snake_case(const std::string &str);
+
+}  // namespace esphome
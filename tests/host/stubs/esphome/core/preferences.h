@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <vector>
+
+namespace esphome {
+
+/// Preferences kept in memory for the lifetime of the process.
+class ESPPreferenceObject {
+ public:
+  ESPPreferenceObject() = default;
+  explicit ESPPreferenceObject(uint32_t key) : key_(key) {}
+
+  template<typename T> bool save(const T *src) {
+    std::vector<uint8_t> &data = store()[key_];
+    data.resize(sizeof(T));
+    memcpy(data.data(), src, sizeof(T));
+    return true;
+  }
+
+  template<typename T> bool load(T *dest) {
+    auto it = store().find(key_);
+    if (it == store().end() || it->second.size() != sizeof(T)) return false;
+    memcpy(dest, it->second.data(), sizeof(T));
+    return true;
+  }
+
+  static std::map<uint32_t, std::vector<uint8_t>> &store() {
+    static std::map<uint32_t, std::vector<uint8_t>> data;
+    return data;
+  }
+
+ protected:
+  uint32_t key_{0};
+};
+
+class ESPPreferences {
+ public:
+  template<typename T> ESPPreferenceObject make_preference(uint32_t key, bool in_flash = false) {
+    return ESPPreferenceObject(key);
+  }
+};
+
+extern ESPPreferences *global_preferences;  // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+}  // namespace esphome
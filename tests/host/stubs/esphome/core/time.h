@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+
+namespace esphome {
+
+struct ESPTime {
+  uint8_t second;
+  uint8_t minute;
+  uint8_t hour;
+  uint8_t day_of_week;
+  uint8_t day_of_month;
+  uint16_t day_of_year;
+  uint8_t month;
+  uint16_t year;
+  time_t timestamp;
+
+  bool is_valid() const { return year >= 2019; }
+
+  void recalc_timestamp_local() {
+    struct tm t {};
+    t.tm_sec = second;
+    t.tm_min = minute;
+    t.tm_hour = hour;
+    t.tm_mday = day_of_month;
+    t.tm_mon = month - 1;
+    t.tm_year = year - 1900;
+    timestamp = timegm(&t);
+  }
+
+  std::string strftime(const char *format) {
+    char buffer[64];
+    struct tm t {};
+    time_t ts = timestamp;
+    gmtime_r(&ts, &t);
+    size_t len = ::strftime(buffer, sizeof(buffer), format, &t);
+    return std::string(buffer, len);
+  }
+};
+
+inline uint8_t days_in_month(uint8_t month, uint16_t year) {
+  static const uint8_t DAYS[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  if (month == 2 && (year % 4 == 0 && (year % 100 != 0 || year % 400 == 0))) return 29;
+  return DAYS[month - 1];
+}
+
+}  // namespace esphome
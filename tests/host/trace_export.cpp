@@ -0,0 +1,41 @@
+#include "trace_export.h"
+
+#ifdef MOENV_AQI_TRACE
+
+#include <cstdio>
+
+namespace esphome {
+namespace moenv_aqi {
+namespace testing {
+
+static void write_string(FILE *file, const char *str) {
+  fputc('"', file);
+  for (const char *c = str; *c != '\0'; c++) {
+    if (*c == '"' || *c == '\\') fputc('\\', file);
+    fputc(*c, file);
+  }
+  fputc('"', file);
+}
+
+// Complete ("X") events carry their own duration, so spans need no begin/end pairing
+bool write_chrome_trace(const Tracer &tracer, const char *path) {
+  FILE *file = fopen(path, "w");
+  if (file == nullptr) return false;
+
+  fputs("[\n", file);
+  for (size_t i = 0; i < tracer.size(); i++) {
+    const TraceSpan &span = tracer[i];
+    fputs("{\"name\":", file);
+    write_string(file, span.name);
+    fprintf(file, ",\"ph\":\"X\",\"ts\":%u,\"dur\":%u,\"pid\":1,\"tid\":1}%s\n", span.start_us, span.duration_us,
+            i + 1 < tracer.size() ? "," : "");
+  }
+  fputs("]\n", file);
+  return fclose(file) == 0;
+}
+
+}  // namespace testing
+}  // namespace moenv_aqi
+}  // namespace esphome
+
+#endif  // MOENV_AQI_TRACE
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "moenv_aqi/trace.h"
+
+namespace esphome {
+namespace moenv_aqi {
+namespace testing {
+
+#ifdef MOENV_AQI_TRACE
+
+/// Write the spans held by tracer to path as a JSON array of Chrome trace events, which
+/// chrome://tracing and Perfetto open as is. Returns false if the file cannot be written.
+bool write_chrome_trace(const Tracer &tracer, const char *path);
+
+#endif  // MOENV_AQI_TRACE
+
+}  // namespace testing
+}  // namespace moenv_aqi
+}  // namespace esphome
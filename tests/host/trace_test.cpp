@@ -0,0 +1,92 @@
+// Writes the spans of a traced multi-page lookup as a Chrome trace file, then reads the
+// file back as a strict JSON array of events
+//
+//   trace_test [path]   keep the trace at path, to open in chrome://tracing or Perfetto
+
+#include <fstream>
+#include <sstream>
+
+#include "fixture.h"
+#include "trace_export.h"
+
+using namespace esphome;
+using namespace esphome::moenv_aqi;
+using namespace esphome::moenv_aqi::testing;
+
+static Device device;  // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+// Reads a string the way deserializeJson() reads an HttpStreamAdapter
+struct StringReader {
+  const std::string &text;
+  size_t pos{0};
+
+  int read() { return pos < text.size() ? static_cast<uint8_t>(text[pos++]) : -1; }
+  int peek() const { return pos < text.size() ? static_cast<uint8_t>(text[pos]) : -1; }
+  size_t readBytes(char *buffer, size_t length) {
+    const size_t n = text.copy(buffer, length, pos);
+    pos += n;
+    return n;
+  }
+  void skip_spaces() {
+    while (peek() == ' ' || peek() == '\n' || peek() == '\r' || peek() == '\t') pos++;
+  }
+};
+
+static bool has_span(const std::vector<std::string> &names, const char *name) {
+  return std::find(names.begin(), names.end(), name) != names.end();
+}
+
+int main(int argc, char **argv) {
+  const char *path = argc > 1 ? argv[1] : "moenv_aqi_trace.json";
+
+  // Four pages, the last three prefetched, to get every kind of span into one pass
+  MoenvAQI *instance = device.add("S77");
+  sensor::Sensor aqi;
+  instance->set_aqi_sensor(&aqi);
+  instance->set_prefetch(true);
+  instance->update();
+  run_scheduler();
+  CHECK(instance->get_data().site_name == "S77");
+  CHECK(global_tracer.size() > 0 && global_tracer.get_dropped() == 0);
+
+  CHECK(write_chrome_trace(global_tracer, path));
+  std::ifstream file(path);
+  std::stringstream contents;
+  contents << file.rdbuf();
+  const std::string text = contents.str();
+
+  StringReader reader{text};
+  reader.skip_spaces();
+  CHECK(reader.read() == '[');
+  std::vector<std::string> names;
+  JsonDocument doc;
+  while (true) {
+    DeserializationError error = deserializeJson(doc, reader);
+    if (error) fprintf(stderr, "event %zu: %s\n", names.size(), error.c_str());
+    CHECK(!error);
+    const char *name = doc["name"].as<const char *>();
+    const char *phase = doc["ph"].as<const char *>();
+    CHECK(name != nullptr && phase != nullptr && strcmp(phase, "X") == 0);
+    CHECK(!doc["ts"].isNull() && !doc["dur"].isNull() && !doc["pid"].isNull() && !doc["tid"].isNull());
+    const TraceSpan &span = global_tracer[names.size()];
+    CHECK(strcmp(name, span.name) == 0 && doc["ts"].as<double>() == span.start_us &&
+          doc["dur"].as<double>() == span.duration_us);
+    names.emplace_back(name);
+
+    reader.skip_spaces();
+    const int separator = reader.read();
+    if (separator == ']') break;
+    CHECK(separator == ',');
+  }
+  reader.skip_spaces();
+  CHECK(reader.read() == -1);
+
+  printf("wrote %zu events to %s\n", names.size(), path);
+  CHECK(names.size() == global_tracer.size());
+  for (const char *name : {"scan", "connect", "prefetch", "page", "read_wait", "find", "deserialize", "map",
+                           "validate", "publish_state", "finish"}) {
+    if (!has_span(names, name)) fprintf(stderr, "no %s span\n", name);
+    CHECK(has_span(names, name));
+  }
+  return 0;
+}